@@ -20,10 +20,24 @@ SNMPAgent snmp = SNMPAgent("public");  // Starts an SMMPAgent instance with the
 
 int changingNumber = 1;
 int settableNumber = 0;
+SNMPPublished<uint64_t> loopCount;     // safe to update from an interrupt or another core while the agent reads it
 
 ValueCallback* changingNumberOID;
 ValueCallback* settableNumberOID;
 
+// the WiFi station as MIB-II's interface 1, see enableRFC1213() below
+class WiFiInterface: public SNMPInterfaceProvider {
+  public:
+    uint32_t count(){ return 1; }
+    bool read(uint32_t index, SNMPInterface& interface){
+        interface.descr = "wlan0";
+        interface.type = 71; // ieee80211
+        WiFi.macAddress(interface.physAddress);
+        interface.operStatus = WiFi.status() == WL_CONNECTED ? 1 : 2;
+        return true;
+    }
+} wifiInterface;
+
 
 void setup(){
     Serial.begin(115200);
@@ -43,7 +57,15 @@ void setup(){
     
     // give snmp a pointer to the UDP object
     snmp.setUDP(&udp);
+    // uncomment to answer requests from a task of its own, then snmp.loop() isn't needed. Change handler
+    // values between snmp.lock() and snmp.unlock()
+    // snmp.useTask();
     snmp.begin();
+
+    // SNMPv3 as well: a read/write user with SHA authentication and AES privacy. Adding a user
+    // hashes each password for a fraction of a second, once
+    snmp.addUser("admin", "authpassword", "privpassword", true);
+    // snmpget -v 3 -l authPriv -u admin -a SHA -A authpassword -x AES -X privpassword <IP> 1.3.6.1.4.1.5.0
     
     // add 'callback' for an OID - pointer to an integer
     changingNumberOID = snmp.addIntegerHandler(".1.3.6.1.4.1.5.0", &changingNumber);
@@ -58,20 +80,32 @@ void setup(){
     // sort_oid(".1.3.6.1.4.1.5.0");
 
     snmp.addIntegerHandler(".1.3.6.1.4.1.4.0", &changingNumber);
+    
+    // or give it a function, which is only called when the OID is asked for. The result is kept
+    // for 1000ms, however many managers poll it in that time
+    snmp.addGuageHandler(".1.3.6.1.4.1.5.2", []() -> uint32_t { return ESP.getFreeHeap(); }, 1000);
+    
+    snmp.addCounter64Handler(".1.3.6.1.4.1.5.3", &loopCount);
+    
+    // sysDescr, sysUpTime, sysName and the rest, and ifTable from the provider above. Managers can set
+    // sysContact, sysName and sysLocation, they're in snmp.systemGroup for saving once setOccurred goes up
+    snmp.setSystemStrings("admin@example.com", "esp32", "rack 1");
+    snmp.enableRFC1213("ESP32 SNMP agent", ".1.3.6.1.4.1.5", &wifiInterface);
 
     
 }
 
 void loop(){
     snmp.loop(); // must be called as often as possible
+    // or, with several managers polling, handle whatever is queued up to 8 packets or 2ms: snmp.loop(8, 2000);
     if(snmp.setOccurred){
         Serial.printf("Number has been set to value: %i\n", settableNumber);
         Serial.println("Lets remove the changingNumber reference");
-        snmp.sortHandlers();
         // if(snmp.removeHandler(settableNumberOID)){
         //     Serial.println("Remove succesful");
         // }
         snmp.resetSetOccurred();
     }
     changingNumber++;
+    loopCount.add(1);
 }
\ No newline at end of file
@@ -80,7 +80,12 @@ void setup(){
 
     settableNumberTrap->setIP(WiFi.localIP()); // Set our Source IP
 
-    snmp.sortHandlers();
+    // With a v2c trap (new SNMPTrap("public", 1)) setInform(true) makes it an InformRequest, which
+    // snmp.loop() sends again until the manager acknowledges it
+    // settableNumberTrap->setInform(true);
+
+    // Managers that every queued trap goes to
+    snmp.addTrapReceiver(IPAddress(172,16,33,82));
 }
 
 void loop(){
@@ -88,7 +93,6 @@ void loop(){
     if(snmp.setOccurred){
         Serial.printf("Number has been set to value: %i\n", settableNumber);
         Serial.println("Lets remove the changingNumber reference");
-        snmp.sortHandlers();
         // if(snmp.removeHandler(settableNumberOID)){
         //     Serial.println("Remove succesful");
         // }
@@ -96,11 +100,12 @@ void loop(){
 
         Serial.println("Lets send out a trap to indicate a changed value");
         
-        IPAddress destinationIP = IPAddress(172,16,33,82);
-        if(settableNumberTrap->sendTo(destinationIP)){ // Send the trap to the specified IP address
-            Serial.println("Sent SNMP Trap");
+        // Encoded now and sent to every receiver from snmp.loop(), a couple of datagrams per call.
+        // snmp.sendTrap(settableNumberTrap, IPAddress(172,16,33,82)) would send it to one manager there and then
+        if(snmp.queueTrap(settableNumberTrap)){
+            Serial.println("Queued SNMP Trap");
         } else {
-            Serial.println("Couldn't send SNMP Trap");
+            Serial.println("Couldn't queue SNMP Trap");
         }
 
     }
@@ -0,0 +1,187 @@
+// A very small Google Benchmark look-alike, so the micro benchmarks build with nothing but a
+// C++11 compiler. Each benchmark runs its loop until it has taken at least minimum time and
+// reports the time and heap allocations per iteration.
+//
+//   static void BM_Something(MicroBench::State& state)
+//   {
+//       while(state.keepRunning()){ ... }
+//   }
+//   MICRO_BENCHMARK(BM_Something);
+//   MICRO_BENCHMARK_ARG(BM_Other, 100);   // state.arg == 100
+//
+// Allocations are counted by replacing the global operator new, which is everything the
+// library allocates per request. malloc is only used when registering handlers and isn't counted.
+
+#ifndef MicroBench_h
+#define MicroBench_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <new>
+#include <vector>
+
+namespace MicroBench {
+
+struct Counters {
+    unsigned long allocations;
+    unsigned long bytes;
+};
+
+inline Counters& counters()
+{
+    static Counters counters = {0, 0};
+    return counters;
+}
+
+inline double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// keeps the compiler from optimising a result away
+template <typename T> inline void doNotOptimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class State {
+  public:
+    State(unsigned long iterations, long argument) : arg(argument), _remaining(iterations) {}
+
+    bool keepRunning()
+    {
+        if(_remaining == 0) return false;
+        _remaining--;
+        return true;
+    }
+
+    long arg;
+
+  private:
+    unsigned long _remaining;
+};
+
+typedef void (*Function)(State&);
+
+struct Benchmark {
+    const char* name;
+    Function function;
+    long argument;
+    bool hasArgument;
+};
+
+inline std::vector<Benchmark>& registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Registrar {
+    Registrar(const char* name, Function function, long argument, bool hasArgument)
+    {
+        Benchmark benchmark = {name, function, argument, hasArgument};
+        registry().push_back(benchmark);
+    }
+};
+
+// usage: [--min-time seconds] [substring filter]
+inline int runAll(int argc, char** argv)
+{
+    double minimumTime = 0.2;
+    const char* filter = 0;
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--min-time") && i + 1 < argc){
+            minimumTime = atof(argv[++i]);
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    printf("%-44s %12s %12s %12s %12s\n", "Benchmark", "Time", "Iterations", "allocs/op", "bytes/op");
+    printf("%.*s\n", 96, "------------------------------------------------------------------------------------------------------------");
+    for(size_t i = 0; i < registry().size(); i++){
+        Benchmark& benchmark = registry()[i];
+        char name[64];
+        if(benchmark.hasArgument){
+            snprintf(name, sizeof(name), "%s/%ld", benchmark.name, benchmark.argument);
+        } else {
+            snprintf(name, sizeof(name), "%s", benchmark.name);
+        }
+        if(filter && !strstr(name, filter)) continue;
+
+        // grow the iteration count until a run is long enough to trust
+        unsigned long iterations = 1;
+        double elapsed = 0;
+        Counters before, after;
+        while(true){
+            State state(iterations, benchmark.argument);
+            before = counters();
+            double start = now();
+            benchmark.function(state);
+            elapsed = now() - start;
+            after = counters();
+            if(elapsed >= minimumTime || iterations >= 1000000000UL) break;
+            double scale = elapsed > 0 ? minimumTime * 1.4 / elapsed : 100;
+            if(scale > 100) scale = 100;
+            if(scale < 2) scale = 2;
+            iterations = (unsigned long)(iterations * scale);
+        }
+
+        printf("%-44s %9.1f ns %12lu %12.2f %12.1f\n", name, elapsed * 1e9 / iterations, iterations,
+            (double)(after.allocations - before.allocations) / iterations,
+            (double)(after.bytes - before.bytes) / iterations);
+    }
+    return 0;
+}
+
+} // namespace MicroBench
+
+#define MICRO_BENCHMARK_CONCAT2(a, b) a##b
+#define MICRO_BENCHMARK_CONCAT(a, b) MICRO_BENCHMARK_CONCAT2(a, b)
+#define MICRO_BENCHMARK(function) \
+    static MicroBench::Registrar MICRO_BENCHMARK_CONCAT(registrar_, __LINE__)(#function, function, 0, false)
+#define MICRO_BENCHMARK_ARG(function, argument) \
+    static MicroBench::Registrar MICRO_BENCHMARK_CONCAT(registrar_, __LINE__)(#function, function, argument, true)
+
+// Counting allocator. Pulled in by every executable that includes this header, once.
+void* operator new(size_t size)
+{
+    MicroBench::counters().allocations++;
+    MicroBench::counters().bytes += size;
+    void* pointer = malloc(size ? size : 1);
+    if(!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+// the deletes are kept out of line, inlined GCC sees free() on what operator new returned and warns
+__attribute__((noinline)) void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+__attribute__((noinline)) void operator delete[](void* pointer) noexcept
+{
+    free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+__attribute__((noinline)) void operator delete[](void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+#endif
@@ -0,0 +1,482 @@
+// Micro benchmarks for the BER primitives and the handler index: the time and heap traffic of
+// encoding and decoding each BER_CONTAINER, of a nested varbind list, of OID comparison and of
+// findCallback with 10, 100 and 1000 handlers.
+//
+//   snmp_ber_bench [--min-time seconds] [filter]
+//
+// Encodes are run through both the legacy front-to-back serialise(buf) and the single pass
+// BERWriter, decodes through both fromBuffer and the allocation free BERReader.
+
+#include <Arduino.h>
+#include <UDP.h>
+#include <Arduino_SNMP.h>
+
+#include "MicroBench.h"
+
+using MicroBench::State;
+using MicroBench::doNotOptimize;
+
+static unsigned char buffer[2048];
+
+template <typename T> static void encodeLegacy(State& state, T& value)
+{
+    while(state.keepRunning()){
+        doNotOptimize(value.serialise(buffer));
+        doNotOptimize(buffer);
+    }
+}
+
+template <typename T> static void encodeWriter(State& state, T& value)
+{
+    while(state.keepRunning()){
+        BERWriter writer(buffer, sizeof(buffer));
+        doNotOptimize(value.serialise(writer));
+        doNotOptimize(buffer);
+    }
+}
+
+// leaves the encoding of value at the start of buffer
+template <typename T> static int encode(T& value)
+{
+    BERWriter writer(buffer, sizeof(buffer));
+    int length = value.serialise(writer);
+    memmove(buffer, writer.data(), length);
+    return length;
+}
+
+template <typename T> static void decodeLegacy(State& state, T& value)
+{
+    T decoded;
+    encode(value);
+    while(state.keepRunning()){
+        doNotOptimize(decoded.fromBuffer(buffer, sizeof(buffer)));
+        doNotOptimize(decoded);
+    }
+}
+
+/* --- IntegerType --- */
+
+static IntegerType integer(-123456);
+
+static void BM_IntegerEncodeLegacy(State& state) { encodeLegacy(state, integer); }
+static void BM_IntegerEncodeWriter(State& state) { encodeWriter(state, integer); }
+static void BM_IntegerDecodeLegacy(State& state) { decodeLegacy(state, integer); }
+static void BM_IntegerDecodeReader(State& state)
+{
+    int length = encode(integer);
+    while(state.keepRunning()){
+        BERReader reader(buffer, length);
+        BERView view;
+        long value = 0;
+        reader.expect(INTEGER, view);
+        BERReader::readInteger(view, value);
+        doNotOptimize(value);
+    }
+}
+MICRO_BENCHMARK(BM_IntegerEncodeLegacy);
+MICRO_BENCHMARK(BM_IntegerEncodeWriter);
+MICRO_BENCHMARK(BM_IntegerDecodeLegacy);
+MICRO_BENCHMARK(BM_IntegerDecodeReader);
+
+/* --- OctetType --- */
+
+static OctetType octets((char*)"a string of moderate length, like a sysDescr");
+
+static void BM_OctetEncodeLegacy(State& state) { encodeLegacy(state, octets); }
+static void BM_OctetEncodeWriter(State& state) { encodeWriter(state, octets); }
+static void BM_OctetDecodeLegacy(State& state) { decodeLegacy(state, octets); }
+static void BM_OctetDecodeReader(State& state)
+{
+    int length = encode(octets);
+    while(state.keepRunning()){
+        BERReader reader(buffer, length);
+        BERView view;
+        reader.expect(STRING, view);
+        doNotOptimize(view);
+    }
+}
+static void BM_OctetConstruct(State& state)
+{
+    while(state.keepRunning()){
+        OctetType* value = new OctetType((char*)"a string of moderate length, like a sysDescr");
+        doNotOptimize(value);
+        delete value;
+    }
+}
+MICRO_BENCHMARK(BM_OctetEncodeLegacy);
+MICRO_BENCHMARK(BM_OctetEncodeWriter);
+MICRO_BENCHMARK(BM_OctetDecodeLegacy);
+MICRO_BENCHMARK(BM_OctetDecodeReader);
+MICRO_BENCHMARK(BM_OctetConstruct);
+
+/* --- OIDType --- */
+
+static OIDType oid((char*)".1.3.6.1.4.1.52420.300.1.2.1.6.16384.0");
+
+static void BM_OIDEncodeLegacy(State& state) { encodeLegacy(state, oid); }
+static void BM_OIDEncodeWriter(State& state) { encodeWriter(state, oid); }
+static void BM_OIDDecodeLegacy(State& state) { decodeLegacy(state, oid); }
+static void BM_OIDDecodeReader(State& state)
+{
+    int length = encode(oid);
+    uint32_t subids[MAX_OID_SUBIDENTIFIERS];
+    while(state.keepRunning()){
+        BERReader reader(buffer, length);
+        BERView view;
+        reader.expect(OID, view);
+        doNotOptimize(BERReader::readOID(view, subids, MAX_OID_SUBIDENTIFIERS));
+        doNotOptimize(subids);
+    }
+}
+static void BM_OIDParse(State& state)
+{
+    uint32_t subids[MAX_OID_SUBIDENTIFIERS];
+    while(state.keepRunning()){
+        doNotOptimize(oid_parse(".1.3.6.1.4.1.52420.300.1.2.1.6.16384.0", subids, MAX_OID_SUBIDENTIFIERS));
+        doNotOptimize(subids);
+    }
+}
+static void BM_OIDFormat(State& state)
+{
+    char text[MAX_OID_LENGTH];
+    while(state.keepRunning()){
+        doNotOptimize(oid.toString(text, sizeof(text)));
+        doNotOptimize(text);
+    }
+}
+MICRO_BENCHMARK(BM_OIDEncodeLegacy);
+MICRO_BENCHMARK(BM_OIDEncodeWriter);
+MICRO_BENCHMARK(BM_OIDDecodeLegacy);
+MICRO_BENCHMARK(BM_OIDDecodeReader);
+MICRO_BENCHMARK(BM_OIDParse);
+MICRO_BENCHMARK(BM_OIDFormat);
+
+/* --- oid_compare, what sorting and searching the handlers is made of --- */
+
+static void BM_OIDCompare(State& state)
+{
+    static const uint32_t left[] = {1, 3, 6, 1, 4, 1, 52420, 300, 1, 2, 1, 6, 16384, 0};
+    static const uint32_t right[] = {1, 3, 6, 1, 4, 1, 52420, 300, 1, 2, 1, 6, 16385, 0};
+    while(state.keepRunning()){
+        doNotOptimize(oid_compare(left, 14, right, 14));
+    }
+}
+MICRO_BENCHMARK(BM_OIDCompare);
+
+/* --- Counter64 --- */
+
+static Counter64 counter64(0x0123456789ABCDEFULL);
+
+static void BM_Counter64EncodeLegacy(State& state) { encodeLegacy(state, counter64); }
+static void BM_Counter64EncodeWriter(State& state) { encodeWriter(state, counter64); }
+static void BM_Counter64DecodeLegacy(State& state) { decodeLegacy(state, counter64); }
+static void BM_Counter64DecodeReader(State& state)
+{
+    int length = encode(counter64);
+    while(state.keepRunning()){
+        BERReader reader(buffer, length);
+        BERView view;
+        uint64_t value = 0;
+        reader.expect(COUNTER64, view);
+        BERReader::readUnsigned(view, value);
+        doNotOptimize(value);
+    }
+}
+MICRO_BENCHMARK(BM_Counter64EncodeLegacy);
+MICRO_BENCHMARK(BM_Counter64EncodeWriter);
+MICRO_BENCHMARK(BM_Counter64DecodeLegacy);
+MICRO_BENCHMARK(BM_Counter64DecodeReader);
+
+/* --- NetworkAddress --- */
+
+static NetworkAddress address(IPAddress(192, 168, 1, 20));
+
+static void BM_NetworkAddressEncodeLegacy(State& state) { encodeLegacy(state, address); }
+static void BM_NetworkAddressEncodeWriter(State& state) { encodeWriter(state, address); }
+static void BM_NetworkAddressDecodeLegacy(State& state) { decodeLegacy(state, address); }
+MICRO_BENCHMARK(BM_NetworkAddressEncodeLegacy);
+MICRO_BENCHMARK(BM_NetworkAddressEncodeWriter);
+MICRO_BENCHMARK(BM_NetworkAddressDecodeLegacy);
+
+/* --- ComplexType, a varbind list of ten as it sits in a response --- */
+
+static ComplexType* buildVarBinds()
+{
+    ComplexType* varBinds = new ComplexType(STRUCTURE);
+    for(int i = 0; i < 10; i++){
+        uint32_t subids[] = {1, 3, 6, 1, 4, 1, 52420, 300, 1, (uint32_t)i, 0};
+        ComplexType* varBind = new ComplexType(STRUCTURE);
+        varBind->addValueToList(new OIDType(subids, 11));
+        if(i % 2){
+            varBind->addValueToList(new IntegerType(i * 1000));
+        } else {
+            varBind->addValueToList(new OctetType((char*)"eth0"));
+        }
+        varBinds->addValueToList(varBind);
+    }
+    return varBinds;
+}
+
+static void BM_VarBindsBuild(State& state)
+{
+    while(state.keepRunning()){
+        ComplexType* varBinds = buildVarBinds();
+        doNotOptimize(varBinds);
+        delete varBinds;
+    }
+}
+// as the agent builds a response, out of its per-request arena
+static void BM_VarBindsBuildArena(State& state)
+{
+    static SNMPArena arena;
+    while(state.keepRunning()){
+        SNMPArenaScope scope(&arena);
+        ComplexType* varBinds = buildVarBinds();
+        doNotOptimize(varBinds);
+        if(arena.spills){
+            delete varBinds; // whatever didn't fit came off the heap
+        }
+    }
+}
+static void BM_VarBindsEncodeLegacy(State& state)
+{
+    ComplexType* varBinds = buildVarBinds();
+    encodeLegacy(state, *varBinds);
+    delete varBinds;
+}
+static void BM_VarBindsEncodeWriter(State& state)
+{
+    ComplexType* varBinds = buildVarBinds();
+    encodeWriter(state, *varBinds);
+    delete varBinds;
+}
+static void BM_VarBindsDecodeLegacy(State& state)
+{
+    ComplexType* varBinds = buildVarBinds();
+    encode(*varBinds);
+    delete varBinds;
+    while(state.keepRunning()){
+        ComplexType* decoded = new ComplexType(STRUCTURE);
+        doNotOptimize(decoded->fromBuffer(buffer, sizeof(buffer)));
+        delete decoded;
+    }
+}
+static void BM_VarBindsDecodeReader(State& state)
+{
+    ComplexType* varBinds = buildVarBinds();
+    int length = encode(*varBinds);
+    delete varBinds;
+    uint32_t subids[MAX_OID_SUBIDENTIFIERS];
+    while(state.keepRunning()){
+        BERReader outer(buffer, length);
+        BERView list, item;
+        outer.expect(STRUCTURE, list);
+        BERReader reader(list);
+        while(reader.next(item)){
+            BERReader varBind(item);
+            BERView name, value;
+            varBind.expect(OID, name);
+            varBind.next(value);
+            doNotOptimize(BERReader::readOID(name, subids, MAX_OID_SUBIDENTIFIERS));
+            doNotOptimize(value);
+        }
+    }
+}
+MICRO_BENCHMARK(BM_VarBindsBuild);
+MICRO_BENCHMARK(BM_VarBindsBuildArena);
+MICRO_BENCHMARK(BM_VarBindsEncodeLegacy);
+MICRO_BENCHMARK(BM_VarBindsEncodeWriter);
+MICRO_BENCHMARK(BM_VarBindsDecodeLegacy);
+MICRO_BENCHMARK(BM_VarBindsDecodeReader);
+
+/* --- findCallback --- */
+
+static int values[1000];
+
+// one agent per handler count, built on first use so registration isn't timed
+static SNMPAgent* agentWith(int handlers)
+{
+    static SNMPAgent* agents[3] = {0, 0, 0};
+    int slot = handlers == 10 ? 0 : handlers == 100 ? 1 : 2;
+    if(!agents[slot]){
+        SNMPAgent* agent = new SNMPAgent("public");
+        agent->beginBulkRegistration(handlers);
+        for(int i = 0; i < handlers; i++){
+            char name[40];
+            snprintf(name, sizeof(name), ".1.3.6.1.4.1.52420.1.%d.0", i);
+            agent->addIntegerHandler(name, &values[i]);
+        }
+        agent->endBulkRegistration();
+        agents[slot] = agent;
+    }
+    return agents[slot];
+}
+
+static void BM_FindCallbackGet(State& state)
+{
+    SNMPAgent* agent = agentWith(state.arg);
+    uint32_t subids[] = {1, 3, 6, 1, 4, 1, 52420, 1, 0, 0};
+    uint32_t i = 0;
+    while(state.keepRunning()){
+        subids[8] = i++ % state.arg;
+        doNotOptimize(agent->findCallback(subids, 10, false));
+    }
+}
+static void BM_FindCallbackGetNext(State& state)
+{
+    SNMPAgent* agent = agentWith(state.arg);
+    uint32_t subids[] = {1, 3, 6, 1, 4, 1, 52420, 1, 0};
+    uint32_t i = 0;
+    while(state.keepRunning()){
+        subids[8] = i++ % state.arg;
+        doNotOptimize(agent->findCallback(subids, 9, true));
+    }
+}
+static void BM_FindCallbackString(State& state)
+{
+    SNMPAgent* agent = agentWith(state.arg);
+    char name[64]; // the prefix and a 64 bit argument at its longest
+    snprintf(name, sizeof(name), ".1.3.6.1.4.1.52420.1.%ld.0", state.arg / 2);
+    while(state.keepRunning()){
+        doNotOptimize(agent->findCallback(name, false));
+    }
+}
+MICRO_BENCHMARK_ARG(BM_FindCallbackGet, 10);
+MICRO_BENCHMARK_ARG(BM_FindCallbackGet, 100);
+MICRO_BENCHMARK_ARG(BM_FindCallbackGet, 1000);
+MICRO_BENCHMARK_ARG(BM_FindCallbackGetNext, 10);
+MICRO_BENCHMARK_ARG(BM_FindCallbackGetNext, 100);
+MICRO_BENCHMARK_ARG(BM_FindCallbackGetNext, 1000);
+MICRO_BENCHMARK_ARG(BM_FindCallbackString, 10);
+MICRO_BENCHMARK_ARG(BM_FindCallbackString, 100);
+MICRO_BENCHMARK_ARG(BM_FindCallbackString, 1000);
+
+/* --- SNMPv3 --- */
+
+// what a 484 byte message costs to check and decrypt, and what a user costs to add
+static SNMPv3User* v3User()
+{
+    static SNMPv3Engine engine;
+    if(!engine.findUser("bench")){
+        engine.addUser("bench", "authpassword", "privpassword", false);
+        engine.localizeKeys();
+    }
+    return engine.findUser("bench");
+}
+
+static void BM_V3Hmac(State& state)
+{
+    SNMPv3User* user = v3User();
+    unsigned char digest[12];
+    while(state.keepRunning()){
+        SNMPv3Engine::hmac(user, buffer, 484, digest);
+        doNotOptimize(digest);
+    }
+}
+static void BM_V3AesCFB(State& state)
+{
+    SNMPv3User* user = v3User();
+    unsigned char iv[16] = {0};
+    while(state.keepRunning()){
+        SNMPAes128(user->localPrivKey).decryptCFB(buffer, 484, iv);
+        doNotOptimize(buffer);
+    }
+}
+static void BM_V3PasswordToKey(State& state)
+{
+    unsigned char key[20];
+    while(state.keepRunning()){
+        SNMPv3Engine::passwordToKey("authpassword", key);
+        doNotOptimize(key);
+    }
+}
+static void BM_V3LocalizeKey(State& state)
+{
+    SNMPv3User* user = v3User();
+    unsigned char engineID[13] = {0x80, 0x00, 0x00, 0x00, 0x05};
+    unsigned char key[20];
+    while(state.keepRunning()){
+        SNMPv3Engine::localizeKey(user->authKey, engineID, sizeof(engineID), key);
+        doNotOptimize(key);
+    }
+}
+MICRO_BENCHMARK(BM_V3Hmac);
+MICRO_BENCHMARK(BM_V3AesCFB);
+MICRO_BENCHMARK(BM_V3PasswordToKey);
+MICRO_BENCHMARK(BM_V3LocalizeKey);
+
+// known answers, so a faster SHA-1 or AES can't quietly get the wrong one: FIPS 180 and 197,
+// SP 800-38A F.3.13 for CFB, and RFC 3414 A.3.2 for the password to key and localization
+static bool checkAnswer(const char* name, const unsigned char* got, const char* expected)
+{
+    char hex[41];
+    int length = strlen(expected) / 2;
+    for(int i = 0; i < length; i++){
+        snprintf(hex + 2 * i, 3, "%02x", got[i]);
+    }
+    if(strcmp(hex, expected)){
+        printf("%s: got %s, expected %s\n", name, hex, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool checkKnownAnswers()
+{
+    bool ok = true;
+    unsigned char digest[20];
+    SNMPSha1 sha;
+    sha.update((const unsigned char*)"abc", 3);
+    sha.finish(digest);
+    ok &= checkAnswer("SHA-1 one block", digest, "a9993e364706816aba3e25717850c26c9cd0d89d");
+    const char* message = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    sha.reset();
+    for(const char* c = message; *c; c++){
+        sha.update((const unsigned char*)c, 1); // a byte at a time, across the block boundary
+    }
+    sha.finish(digest);
+    ok &= checkAnswer("SHA-1 two blocks", digest, "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+    
+    unsigned char key[16], block[16];
+    for(int i = 0; i < 16; i++){
+        key[i] = i;
+        block[i] = i * 0x11;
+    }
+    SNMPAes128(key).encryptBlock(block);
+    ok &= checkAnswer("AES-128", block, "69c4e0d86a7b0430d8cdb78070b4c55a");
+    const unsigned char cfbKey[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+    const unsigned char cfbPlain[16] = {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a};
+    unsigned char iv[16];
+    for(int i = 0; i < 16; i++){
+        iv[i] = i;
+    }
+    memcpy(block, cfbPlain, 16);
+    SNMPAes128(cfbKey).encryptCFB(block, 16, iv);
+    ok &= checkAnswer("AES-128-CFB", block, "3b3fd92eb72dad20333449f8e83cfb4a");
+    SNMPAes128(cfbKey).decryptCFB(block, 16, iv);
+    ok &= !memcmp(block, cfbPlain, 16);
+    
+    // the engine's own path: password to Ku, localized to Kul, and HMAC-SHA-96 from the precomputed key blocks
+    SNMPv3Engine::passwordToKey("maplesyrup", digest);
+    ok &= checkAnswer("RFC 3414 Ku", digest, "9fb5cc0381497b3793528939ff788d5d79145211");
+    SNMPv3Engine engine;
+    const unsigned char engineID[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2};
+    engine.setEngineID(engineID, sizeof(engineID));
+    engine.addUser("known", "maplesyrup", 0, false);
+    engine.localizeKeys();
+    SNMPv3User* user = engine.findUser("known");
+    ok &= checkAnswer("RFC 3414 Kul", user->localAuthKey, "6695febc9288e36282235fc7151f128497b38f3f");
+    SNMPv3Engine::hmac(user, (const unsigned char*)"Hi There", 8, digest);
+    ok &= checkAnswer("HMAC-SHA-96", digest, "264347370131b3a01b7c3fae");
+    
+    printf("known answers: %s\n\n", ok ? "ok" : "MISMATCH");
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    if(!checkKnownAnswers()){
+        return 1;
+    }
+    return MicroBench::runAll(argc, argv);
+}
@@ -0,0 +1,168 @@
+// Inform benchmark: the agent sends v2c informs over loopback to a stand-in manager in another
+// thread, which drops a share of them and acknowledges the rest. Reports how many informs were
+// acknowledged, retried and given up on, and the time from queueTrap() to the acknowledgement.
+//
+//   snmp_inform_bench [-n informs] [-d percent dropped] [-t timeout ms] [-r retries]
+
+#include <Arduino.h>
+#include <PosixUDP.h>
+#include <Arduino_SNMP.h>
+
+#include <poll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static PosixUDP udp("127.0.0.1");
+static SNMPAgent snmp("public");
+static std::atomic<bool> running(true);
+
+static std::mutex timesLock;
+static std::vector<unsigned long> queuedAt;        // by request-id
+static std::vector<unsigned long> acknowledgedAt;  // by request-id, 0 until the manager answers
+
+static int dropPercent = 10;
+static std::atomic<unsigned long> received(0);
+static std::atomic<unsigned long> dropped(0);
+
+// the request-id of an InformRequest, and where its PDU tag is so it can be answered in place
+static bool readInform(unsigned char* buffer, int length, long* requestID, int* tagOffset)
+{
+    BERView view;
+    BERReader packet(buffer, length);
+    if(!packet.expect(STRUCTURE, view)) return false;
+    BERReader message(view);
+    if(!message.expect(INTEGER, view) || !message.expect(STRING, view) || !message.expect(InformRequestPDU, view)) return false;
+    *tagOffset = view.value - buffer - 1;
+    while(buffer[*tagOffset] != InformRequestPDU) (*tagOffset)--; // back over the length octets
+    BERReader pdu(view);
+    return pdu.expect(INTEGER, view) && BERReader::readInteger(view, *requestID);
+}
+
+// acknowledges an inform the way a manager does, with a Response carrying the same request-id and
+// varbinds, which is the inform with its PDU tag changed
+static void managerThread(int manager)
+{
+    unsigned char buffer[2048];
+    pollfd watch = {manager, POLLIN, 0};
+    while(running){
+        if(poll(&watch, 1, 10) <= 0){
+            continue;
+        }
+        sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+        int length = recvfrom(manager, buffer, sizeof(buffer), 0, (sockaddr*)&from, &fromLength);
+        long requestID;
+        int tagOffset;
+        if(length <= 0 || !readInform(buffer, length, &requestID, &tagOffset)){
+            continue;
+        }
+        received++;
+        if(rand() % 100 < dropPercent){
+            dropped++;
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> guard(timesLock);
+            if(requestID > 0 && requestID < (long)acknowledgedAt.size() && !acknowledgedAt[requestID]){
+                acknowledgedAt[requestID] = micros();
+            }
+        }
+        buffer[tagOffset] = GetResponsePDU;
+        sendto(manager, buffer, length, 0, (sockaddr*)&from, fromLength);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int informs = 2000;
+    unsigned long timeout = 20;
+    int retries = 4;
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "-n")) informs = atoi(argv[i + 1]);
+        if(!strcmp(argv[i], "-d")) dropPercent = atoi(argv[i + 1]);
+        if(!strcmp(argv[i], "-t")) timeout = atol(argv[i + 1]);
+        if(!strcmp(argv[i], "-r")) retries = atoi(argv[i + 1]);
+    }
+    srand(1);
+
+    snmp.setUDP(&udp);
+    if(!snmp.begin((uint16_t)0)){
+        fprintf(stderr, "could not bind 127.0.0.1\n");
+        return 1;
+    }
+    snmp.setInformTimeout(timeout, retries);
+    static int uptime = 0;
+    static int value = 0;
+    TimestampCallback* uptimeCallback = (TimestampCallback*)snmp.addTimestampHandler((char*)".1.3.6.1.2.1.1.3.0", &uptime);
+    ValueCallback* valueCallback = snmp.addIntegerHandler((char*)".1.3.6.1.4.1.9999.1.1.0", &value);
+
+    int manager = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = sockaddr_in();
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    bind(manager, (sockaddr*)&address, sizeof(address));
+    socklen_t addressLength = sizeof(address);
+    getsockname(manager, (sockaddr*)&address, &addressLength);
+    snmp.addTrapReceiver(IPAddress(127, 0, 0, 1), ntohs(address.sin_port));
+
+    // a trap object per inform, queueing one that's still pending would replace it
+    std::vector<SNMPTrap*> traps;
+    for(int i = 0; i < informs; i++){
+        SNMPTrap* trap = new SNMPTrap("public", 1);
+        trap->setTrapOID(new OIDType((char*)".1.3.6.1.4.1.9999.2"));
+        trap->setUptimeCallback(uptimeCallback);
+        trap->addOIDPointer(valueCallback);
+        trap->setInform(true);
+        traps.push_back(trap);
+    }
+    queuedAt.assign(informs + 1, 0);
+    acknowledgedAt.assign(informs + 1, 0);
+
+    std::thread managerRunner(managerThread, manager);
+
+    int queued = 0;
+    unsigned long started = micros();
+    pollfd watch = {udp.fd(), POLLIN, 0};
+    while(queued < informs || snmp.trapStats.informsPending){
+        while(queued < informs && snmp.trapStats.informsPending < SNMP_INFORM_PENDING){
+            SNMPTrap* trap = traps[queued];
+            value = queued;
+            unsigned long now = micros();
+            snmp.queueTrap(trap);
+            std::lock_guard<std::mutex> guard(timesLock);
+            queuedAt[trap->requestID] = now;
+            queued++;
+        }
+        snmp.loop(4);
+        poll(&watch, 1, 1);
+    }
+    unsigned long elapsed = micros() - started;
+
+    running = false;
+    managerRunner.join();
+
+    std::vector<unsigned long> latencies;
+    for(int i = 1; i <= informs; i++){
+        if(acknowledgedAt[i]){
+            latencies.push_back(acknowledgedAt[i] - queuedAt[i]);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    SNMPTrapQueueStats& stats = snmp.trapStats;
+    printf("%d informs, %d%% dropped by the manager, timeout %lu ms, %d retries, %d pending at once\n", informs, dropPercent, timeout, retries, SNMP_INFORM_PENDING);
+    printf("sent %lu   received %lu   dropped %lu   retry rounds %lu   acknowledged %lu   timed out %lu   %.0f informs/s\n",
+        stats.sent, received.load(), dropped.load(), stats.informRetries, stats.acknowledged, stats.timedOut, informs / (elapsed / 1e6));
+    if(!latencies.empty()){
+        printf("queued to acknowledged   p50 %6lu us   p99 %6lu us   max %6lu us\n",
+            latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back());
+    }
+
+    for(SNMPTrap* trap : traps) delete trap;
+    close(manager);
+    return 0;
+}
@@ -0,0 +1,222 @@
+// Loopback benchmark: the agent answers on a real UDP socket in one thread while this
+// thread fires pre-encoded Get, GetNext, GetBulk and Set requests at it and times each
+// round trip. With -t 1 the agent runs in its own task (SNMPAgent::useTask) instead of
+// being polled from a thread here.
+//
+//   snmp_loopback_bench [-n requests per workload] [-h handlers] [-p port] [-t 1]
+
+#include <Arduino.h>
+#include <PosixUDP.h>
+#include <Arduino_SNMP.h>
+
+#include <poll.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+typedef std::vector<unsigned char> Packet;
+
+static PosixUDP udp("127.0.0.1");
+static SNMPAgent snmp("public");
+static std::atomic<bool> running(true);
+
+static int values[4096];
+static int settable = 0;
+static char text[] = "a string of moderate length, like a sysDescr";
+static char* textPointer = text;
+
+static void agentThread()
+{
+    pollfd watch = {udp.fd(), POLLIN, 0};
+    while(running){
+        if(poll(&watch, 1, 10) > 0){
+            snmp.loop();
+        }
+    }
+}
+
+// lets the agent's task block on the socket rather than sleep between polls
+static void waitForRequest(unsigned long timeoutMs)
+{
+    pollfd watch = {udp.fd(), POLLIN, 0};
+    poll(&watch, 1, timeoutMs);
+}
+
+static void handlerOID(int index, uint32_t* oid, int* length)
+{
+    static const uint32_t base[] = {1, 3, 6, 1, 4, 1, 9999, 1};
+    memcpy(oid, base, sizeof(base));
+    oid[8] = index;
+    oid[9] = 0;
+    *length = 10;
+}
+
+// the request is encoded with the library's own BER classes
+static Packet encodeRequest(ASN_TYPE pduType, long requestID, const std::vector<int>& handlerIndexes, int nonRepeaters = 0, int maxRepetitions = 0, long setValue = 0)
+{
+    ComplexType packet(STRUCTURE);
+    packet.addValueToList(new IntegerType(1));
+    packet.addValueToList(new OctetType((char*)"public"));
+    ComplexType* pdu = new ComplexType(pduType);
+    pdu->addValueToList(new IntegerType(requestID));
+    pdu->addValueToList(new IntegerType(nonRepeaters));
+    pdu->addValueToList(new IntegerType(maxRepetitions));
+    ComplexType* varBinds = new ComplexType(STRUCTURE);
+    for(size_t i = 0; i < handlerIndexes.size(); i++){
+        uint32_t oid[10];
+        int length;
+        handlerOID(handlerIndexes[i], oid, &length);
+        ComplexType* varBind = new ComplexType(STRUCTURE);
+        varBind->addValueToList(new OIDType(oid, length));
+        if(pduType == SetRequestPDU){
+            varBind->addValueToList(new IntegerType(setValue));
+        } else {
+            varBind->addValueToList(new NullType());
+        }
+        varBinds->addValueToList(varBind);
+    }
+    pdu->addValueToList(varBinds);
+    packet.addValueToList(pdu);
+
+    unsigned char buffer[2048];
+    BERWriter writer(buffer, sizeof(buffer));
+    packet.serialise(writer);
+    return Packet(writer.data(), writer.data() + writer.length());
+}
+
+static bool checkResponse(unsigned char* buffer, int length, long requestID)
+{
+    BERView view;
+    BERReader packet(buffer, length);
+    if(!packet.expect(STRUCTURE, view)) return false;
+    BERReader message(view);
+    long number;
+    if(!message.expect(INTEGER, view) || !message.expect(STRING, view) || !message.expect(GetResponsePDU, view)) return false;
+    BERReader pdu(view);
+    if(!pdu.expect(INTEGER, view) || !BERReader::readInteger(view, number) || number != requestID) return false;
+    if(!pdu.expect(INTEGER, view) || !BERReader::readInteger(view, number) || number != 0) return false;
+    return true;
+}
+
+struct Workload {
+    const char* name;
+    std::vector<Packet> requests;
+};
+
+static void run(int client, Workload& workload, int count)
+{
+    std::vector<unsigned long> latencies;
+    latencies.reserve(count);
+    unsigned char buffer[2048];
+    int failures = 0;
+
+    unsigned long started = micros();
+    for(int i = 0; i < count; i++){
+        Packet& request = workload.requests[i % workload.requests.size()];
+        unsigned long sent = micros();
+        send(client, request.data(), request.size(), 0);
+        int length = recv(client, buffer, sizeof(buffer), 0);
+        latencies.push_back(micros() - sent);
+        if(length <= 0 || !checkResponse(buffer, length, i % workload.requests.size())){
+            failures++;
+        }
+    }
+    unsigned long elapsed = micros() - started;
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-10s %8d req %10.0f req/s   p50 %6lu us   p99 %6lu us   max %6lu us   failed %d\n",
+        workload.name, count, count / (elapsed / 1e6),
+        latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back(), failures);
+}
+
+int main(int argc, char** argv)
+{
+    int requests = 20000;
+    int handlers = 100;
+    int port = 0;
+    bool task = false;
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "-n")) requests = atoi(argv[i + 1]);
+        if(!strcmp(argv[i], "-h")) handlers = atoi(argv[i + 1]);
+        if(!strcmp(argv[i], "-p")) port = atoi(argv[i + 1]);
+        if(!strcmp(argv[i], "-t")) task = atoi(argv[i + 1]);
+    }
+    handlers = std::max(16, std::min(handlers, 4096));
+
+    snmp.setUDP(&udp);
+    if(task){
+        snmp.useTask();
+        snmp.setTaskWait(waitForRequest);
+    }
+    if(!snmp.begin(port)){
+        fprintf(stderr, "could not bind 127.0.0.1:%d\n", port);
+        return 1;
+    }
+    snmp.beginBulkRegistration(handlers);
+    for(int i = 0; i < handlers; i++){
+        char oid[40];
+        snprintf(oid, sizeof(oid), ".1.3.6.1.4.1.9999.1.%d.0", i);
+        values[i] = i;
+        if(i == 1){
+            snmp.addIntegerHandler(oid, &settable, true);
+        } else if(i == 2){
+            snmp.addStringHandler(oid, &textPointer);
+        } else {
+            snmp.addIntegerHandler(oid, &values[i]);
+        }
+    }
+    snmp.endBulkRegistration();
+
+    int client = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in agent = sockaddr_in();
+    agent.sin_family = AF_INET;
+    agent.sin_port = htons(udp.localPort());
+    inet_pton(AF_INET, "127.0.0.1", &agent.sin_addr);
+    connect(client, (sockaddr*)&agent, sizeof(agent));
+    timeval timeout = {1, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::thread agentRunner;
+    if(!task){
+        agentRunner = std::thread(agentThread);
+    }
+
+    // a pool of requests per workload, the request-id is the index into the pool
+    int pool = 64;
+    Workload get = {"get", {}}, get10 = {"get10", {}}, poll10 = {"poll10", {}}, next = {"getnext", {}}, bulk = {"getbulk10", {}}, set = {"set", {}};
+    for(int i = 0; i < pool; i++){
+        std::vector<int> one(1, 3 + i % (handlers - 3));
+        std::vector<int> ten;
+        for(int k = 0; k < 10; k++) ten.push_back(3 + (i + k) % (handlers - 3));
+        get.requests.push_back(encodeRequest(GetRequestPDU, i, one));
+        get10.requests.push_back(encodeRequest(GetRequestPDU, i, ten));
+        // a poller asking for the same ten OIDs every time, only the request-id changes
+        std::vector<int> same;
+        for(int k = 0; k < 10; k++) same.push_back(3 + k);
+        poll10.requests.push_back(encodeRequest(GetRequestPDU, i, same));
+        next.requests.push_back(encodeRequest(GetNextRequestPDU, i, one));
+        bulk.requests.push_back(encodeRequest(GetBulkRequestPDU, i, one, 0, 10));
+        set.requests.push_back(encodeRequest(SetRequestPDU, i, std::vector<int>(1, 1), 0, 0, i));
+    }
+
+    printf("agent on 127.0.0.1:%d with %d handlers, SNMP_PACKET_LENGTH %d%s\n", udp.localPort(), handlers, SNMP_PACKET_LENGTH, task ? ", in its own task" : "");
+    Workload* workloads[] = {&get, &get10, &poll10, &next, &bulk, &set};
+    for(Workload* workload : workloads){
+        run(client, *workload, requests);
+    }
+
+    running = false;
+    if(task){
+        snmp.stop();
+    } else {
+        agentRunner.join();
+    }
+    SNMPAgentStats& stats = snmp.stats;
+    printf("agent side: %u requests   min %u us   avg %u us   max %u us   at most %u bytes per request   %u dropped\n",
+        stats.requests, stats.minMicros, stats.averageMicros, stats.maxMicros, stats.peakRequestBytes, stats.silentDrops + stats.inASNParseErrs);
+    close(client);
+    return 0;
+}
@@ -0,0 +1,69 @@
+// Just enough of the Arduino core for the agent to build and run on a POSIX host,
+// see PosixUDP.h for the network side. Not a general purpose Arduino emulation.
+
+#ifndef HostArduino_h
+#define HostArduino_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#include "IPAddress.h"
+
+typedef uint8_t byte;
+
+#define F(str) (str)
+#define HEX 16
+#define DEC 10
+
+inline unsigned long micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+inline void delay(unsigned long ms)
+{
+    if(ms) usleep(ms * 1000);
+}
+
+inline void yield() {}
+
+class String : public std::string {
+  public:
+    String(const char* s = "") : std::string(s ? s : "") {}
+};
+
+// Serial goes to stdout, only used when SNMP_DEBUG is on
+class HostSerial {
+  public:
+    void begin(unsigned long) {}
+    template<typename T> void print(const T& v) { printValue(v); }
+    template<typename T> void print(const T& v, int base) { ::printf(base == HEX ? "%lx" : "%ld", (long)v); }
+    template<typename T> void println(const T& v) { printValue(v); ::printf("\n"); }
+    template<typename T> void println(const T& v, int base) { print(v, base); ::printf("\n"); }
+    void println() { ::printf("\n"); }
+    template<typename... Args> void printf(const char* fmt, Args... args) { ::printf(fmt, args...); }
+    void printf(const char* fmt) { ::printf("%s", fmt); }
+
+  private:
+    void printValue(const char* v) { ::printf("%s", v); }
+    void printValue(const String& v) { ::printf("%s", v.c_str()); }
+    void printValue(const IPAddress& v) { ::printf("%d.%d.%d.%d", v[0], v[1], v[2], v[3]); }
+    template<typename T> void printValue(const T& v) { ::printf("%lld", (long long)v); }
+};
+
+static HostSerial Serial __attribute__((unused));
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef HostIPAddress_h
+#define HostIPAddress_h
+
+#include <stdint.h>
+
+class IPAddress {
+  public:
+    IPAddress() : _addr{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _addr{a, b, c, d} {}
+    IPAddress(const uint8_t* addr) : _addr{addr[0], addr[1], addr[2], addr[3]} {}
+
+    uint8_t operator[](int index) const { return _addr[index]; }
+    uint8_t& operator[](int index) { return _addr[index]; }
+    bool operator==(const IPAddress& other) const
+    {
+        return _addr[0] == other._addr[0] && _addr[1] == other._addr[1] && _addr[2] == other._addr[2] && _addr[3] == other._addr[3];
+    }
+    bool operator!=(const IPAddress& other) const { return !(*this == other); }
+
+  private:
+    uint8_t _addr[4];
+};
+
+#endif
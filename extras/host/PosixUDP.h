@@ -0,0 +1,162 @@
+// Arduino UDP interface on top of a plain non-blocking POSIX datagram socket, so the agent's
+// loop() behaves as it does on a board: parsePacket() returns 0 straight away when nothing is queued.
+
+#ifndef PosixUDP_h
+#define PosixUDP_h
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "UDP.h"
+
+#ifndef POSIX_UDP_BUFFER
+#define POSIX_UDP_BUFFER 65536
+#endif
+
+class PosixUDP : public UDP {
+  public:
+    PosixUDP(const char* bindAddress = "0.0.0.0") : _bindAddress(bindAddress) {}
+    ~PosixUDP() { stop(); }
+
+    uint8_t begin(uint16_t port)
+    {
+        stop();
+        _fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if(_fd < 0) return 0;
+        int on = 1;
+        setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+
+        sockaddr_in addr = sockaddr_in();
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, _bindAddress, &addr.sin_addr);
+        if(bind(_fd, (sockaddr*)&addr, sizeof(addr)) < 0){
+            stop();
+            return 0;
+        }
+        return 1;
+    }
+
+    void stop()
+    {
+        if(_fd >= 0) close(_fd);
+        _fd = -1;
+        _rxLength = _rxPosition = _txLength = 0;
+    }
+
+    // the socket, for callers that want to poll() on it instead of spinning on loop()
+    int fd() { return _fd; }
+
+    bool waitForPacket(unsigned long timeoutMs)
+    {
+        if(_fd < 0) return false;
+        pollfd watch = {_fd, POLLIN, 0};
+        poll(&watch, 1, timeoutMs);
+        return true;
+    }
+
+    // port actually bound, useful after begin(0)
+    uint16_t localPort()
+    {
+        sockaddr_in addr;
+        socklen_t length = sizeof(addr);
+        if(_fd < 0 || getsockname(_fd, (sockaddr*)&addr, &length) < 0) return 0;
+        return ntohs(addr.sin_port);
+    }
+
+    int beginPacket(IPAddress ip, uint16_t port)
+    {
+        _txAddress = sockaddr_in();
+        _txAddress.sin_family = AF_INET;
+        _txAddress.sin_port = htons(port);
+        uint8_t octets[4] = {ip[0], ip[1], ip[2], ip[3]};
+        memcpy(&_txAddress.sin_addr, octets, 4);
+        _txLength = 0;
+        return _fd >= 0;
+    }
+
+    int endPacket()
+    {
+        if(_fd < 0) return 0;
+        ssize_t sent = sendto(_fd, _tx, _txLength, 0, (sockaddr*)&_txAddress, sizeof(_txAddress));
+        _txLength = 0;
+        return sent >= 0;
+    }
+
+    size_t write(uint8_t value)
+    {
+        return write(&value, 1);
+    }
+
+    size_t write(const uint8_t* buffer, size_t size)
+    {
+        if(size > sizeof(_tx) - _txLength) size = sizeof(_tx) - _txLength;
+        memcpy(_tx + _txLength, buffer, size);
+        _txLength += size;
+        return size;
+    }
+
+    int parsePacket()
+    {
+        if(_fd < 0) return 0;
+        socklen_t length = sizeof(_rxAddress);
+        ssize_t received = recvfrom(_fd, _rx, sizeof(_rx), 0, (sockaddr*)&_rxAddress, &length);
+        _rxPosition = 0;
+        _rxLength = received > 0 ? received : 0;
+        return _rxLength;
+    }
+
+    int available() { return _rxLength - _rxPosition; }
+
+    int read()
+    {
+        return _rxPosition < _rxLength ? _rx[_rxPosition++] : -1;
+    }
+
+    int read(unsigned char* buffer, size_t len)
+    {
+        size_t count = available();
+        if(len < count) count = len;
+        memcpy(buffer, _rx + _rxPosition, count);
+        _rxPosition += count;
+        return count;
+    }
+
+    int peek()
+    {
+        return _rxPosition < _rxLength ? _rx[_rxPosition] : -1;
+    }
+
+    void flush()
+    {
+        _rxPosition = _rxLength;
+    }
+
+    IPAddress remoteIP()
+    {
+        return IPAddress((const uint8_t*)&_rxAddress.sin_addr);
+    }
+
+    uint16_t remotePort()
+    {
+        return ntohs(_rxAddress.sin_port);
+    }
+
+  private:
+    const char* _bindAddress;
+    int _fd = -1;
+    uint8_t _rx[POSIX_UDP_BUFFER];
+    size_t _rxLength = 0;
+    size_t _rxPosition = 0;
+    sockaddr_in _rxAddress = sockaddr_in();
+    uint8_t _tx[POSIX_UDP_BUFFER];
+    size_t _txLength = 0;
+    sockaddr_in _txAddress = sockaddr_in();
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef HostUDP_h
+#define HostUDP_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "IPAddress.h"
+
+// Same shape as the Arduino core's UDP class, which is what the agent talks to
+class UDP {
+  public:
+    virtual ~UDP() {}
+    virtual uint8_t begin(uint16_t port) = 0;
+    virtual void stop() = 0;
+    virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+    virtual int endPacket() = 0;
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+    virtual int parsePacket() = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(unsigned char* buffer, size_t len) = 0;
+    virtual int read(char* buffer, size_t len) { return read((unsigned char*)buffer, len); }
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    virtual IPAddress remoteIP() = 0;
+    virtual uint16_t remotePort() = 0;
+
+    // not in the Arduino class: blocks until a packet is queued or timeoutMs have passed, so the
+    // agent's task doesn't have to sleep and poll. False if this transport can't be waited on
+    virtual bool waitForPacket(unsigned long timeoutMs) { (void)timeoutMs; return false; }
+};
+
+#endif
@@ -0,0 +1,106 @@
+// An agent to point real SNMP tools at: a handful of handlers under .1.3.6.1.4.1.5, community
+// "public", and two SNMPv3 users, "admin" (authPriv, read/write) and "monitor" (authNoPriv, read only),
+// both with the passwords "authpassword" and "privpassword". MIB-II's system group is there, and its
+// interfaces group lists the host's interfaces from /proc/net/dev. The agent's own counters are in the
+// snmp group (.1.3.6.1.2.1.11) and under .1.3.6.1.4.1.5.9. Runs until it's killed.
+//
+//   snmp_host_agent [-p port] [-a bind address]
+
+#include <Arduino.h>
+#include <PosixUDP.h>
+#include <Arduino_SNMP.h>
+
+#include <poll.h>
+
+static int changingNumber = 0;
+static int settableNumber = 0;
+static char text[64] = "Arduino_SNMP on a host";
+static char* textPointer = text;
+
+// ifTable from /proc/net/dev, read afresh for every row asked for
+class ProcInterfaces: public SNMPInterfaceProvider {
+  public:
+    uint32_t count()
+    {
+        uint32_t lines = 0;
+        FILE* dev = fopen("/proc/net/dev", "r");
+        char line[512];
+        while(dev && fgets(line, sizeof(line), dev)){
+            lines++;
+        }
+        if(dev) fclose(dev);
+        return lines > 2 ? lines - 2 : 0; // two lines of headings
+    }
+
+    bool read(uint32_t index, SNMPInterface& interface)
+    {
+        FILE* dev = fopen("/proc/net/dev", "r");
+        if(!dev) return false;
+        char line[512];
+        bool found = false;
+        for(uint32_t i = 0; fgets(line, sizeof(line), dev); i++){
+            unsigned long long in[8], out[8];
+            if(i != index + 1 || sscanf(line, " %31[^:]: %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu", _name,
+                &in[0], &in[1], &in[2], &in[3], &in[4], &in[5], &in[6], &in[7], &out[0], &out[1], &out[2], &out[3], &out[4], &out[5], &out[6], &out[7]) != 17){
+                continue;
+            }
+            interface.descr = _name;
+            interface.type = strcmp(_name, "lo") ? 6 : 24;
+            interface.inOctets = in[0];
+            interface.inUcastPkts = in[1];
+            interface.inErrors = in[2];
+            interface.inDiscards = in[3];
+            interface.inNUcastPkts = in[7];
+            interface.outOctets = out[0];
+            interface.outUcastPkts = out[1];
+            interface.outErrors = out[2];
+            interface.outDiscards = out[3];
+            found = true;
+            break;
+        }
+        fclose(dev);
+        return found;
+    }
+
+  private:
+    char _name[32];
+};
+
+int main(int argc, char** argv)
+{
+    int port = 16161;
+    const char* address = "127.0.0.1";
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "-p")) port = atoi(argv[i + 1]);
+        if(!strcmp(argv[i], "-a")) address = argv[i + 1];
+    }
+
+    static PosixUDP udp(address);
+    static SNMPAgent snmp("public");
+    snmp.setUDP(&udp);
+    if(!snmp.begin((uint16_t)port)){
+        fprintf(stderr, "could not bind %s:%d\n", address, port);
+        return 1;
+    }
+    snmp.addIntegerHandler((char*)".1.3.6.1.4.1.5.0", &changingNumber);
+    snmp.addIntegerHandler((char*)".1.3.6.1.4.1.5.1", &settableNumber, true);
+    snmp.addStringHandler((char*)".1.3.6.1.4.1.5.2", &textPointer, true, false, sizeof(text));
+    snmp.enableStats(".1.3.6.1.4.1.5.9");
+    static ProcInterfaces interfaces;
+    snmp.setSystemStrings("root@localhost", "host_agent", "here");
+    snmp.enableRFC1213("Arduino_SNMP host agent", ".1.3.6.1.4.1.5", &interfaces);
+#if SNMP_V3
+    snmp.addUser("admin", "authpassword", "privpassword", true);
+    snmp.addUser("monitor", "authpassword");
+#endif
+    printf("agent on %s:%d\n", address, udp.localPort());
+    fflush(stdout);
+
+    pollfd watch = {udp.fd(), POLLIN, 0};
+    while(true){
+        if(poll(&watch, 1, 100) > 0){
+            snmp.loop(8);
+        }
+        changingNumber++;
+    }
+}
@@ -15,6 +15,49 @@
 		#endif
 	#endif
 	
+	#ifndef SNMP_RX_BUFFER_LENGTH
+		#define SNMP_RX_BUFFER_LENGTH SNMP_PACKET_LENGTH  // Longest request that will be read, anything longer is dropped.
+	#endif
+	
+	#ifndef SNMP_TX_BUFFER_LENGTH
+		#define SNMP_TX_BUFFER_LENGTH SNMP_PACKET_LENGTH  // Longest response or trap that will be sent. A response that doesn't fit is answered with tooBig.
+	#endif
+	
+	#ifndef SNMP_TRAP_QUEUE_LENGTH
+		#if defined(ESP32) || !defined(ARDUINO)
+			#define SNMP_TRAP_QUEUE_LENGTH 8  // traps waiting to go out, queueTrap() fails once this many are pending
+		#else
+			#define SNMP_TRAP_QUEUE_LENGTH 4
+		#endif
+	#endif
+	
+	#ifndef SNMP_TRAP_RECEIVERS
+		#define SNMP_TRAP_RECEIVERS 4  // managers every queued trap goes to
+	#endif
+	#if SNMP_TRAP_RECEIVERS > 8
+		#error "SNMP_TRAP_RECEIVERS can be 8 at most, each queued trap keeps a bit per receiver"
+	#endif
+	
+	#ifndef SNMP_TRAP_SENDS_PER_LOOP
+		#define SNMP_TRAP_SENDS_PER_LOOP 2  // datagrams loop() sends from the trap queue per call, so a burst doesn't hold it up
+	#endif
+	
+	#ifndef SNMP_INFORM_PENDING
+		#define SNMP_INFORM_PENDING 4  // informs waiting on an acknowledgement at once
+	#endif
+	
+	#ifndef SNMP_INFORM_TIMEOUT
+		#define SNMP_INFORM_TIMEOUT 1000  // ms before the first resend, doubled for each one after
+	#endif
+	
+	#ifndef SNMP_INFORM_RETRIES
+		#define SNMP_INFORM_RETRIES 3  // resends before a receiver is given up on
+	#endif
+	
+	#ifndef SNMP_INFORM_MAX_TIMEOUT
+		#define SNMP_INFORM_MAX_TIMEOUT 60000  // ms, the doubling stops here however many resends are allowed
+	#endif
+	
 	#ifndef SNMP_DEBUG
 		#define SNMP_DEBUG 			0
 	#endif
@@ -30,21 +73,44 @@
 	#endif
 	
 	#define MIN(X, Y) ((X < Y) ? X : Y)
+	#ifndef MAX
+	#define MAX(X, Y) ((X > Y) ? X : Y)
+	#endif
 	
 	#include <UDP.h>
 	
 	#include "BER.h"
 	#include "VarBinds.h"
+	#include "SNMPv3.h"
 	#include "SNMPRequest.h"
 	#include "SNMPResponse.h"
+	#include "SNMPTask.h"
+	#include "SNMPPublished.h"
+	
+	class ValueCallback;
+	
+	// Checks a value before a Set writes anything: number is what an INTEGER or TIMESTAMP would be set to
+	// (in tenths for a float handler), bytes and length what a STRING would. NO_ERROR lets it through,
+	// anything else fails the whole Set with that error, WRONG_VALUE for one that's out of range
+	typedef ERROR_STATUS (*SNMPSetValidator)(ValueCallback* callback, long number, const unsigned char* bytes, int length);
 	
 	class ValueCallback {
 	  public:
 	    ValueCallback(ASN_TYPE atype): type(atype){};
+	    virtual ~ValueCallback(){};
 	    char* OID;
+	    uint32_t* oidSubids = 0;    // OID with the agent prefix applied, what requests are matched against
+	    uint8_t oidLength = 0;
 	    ASN_TYPE type;
 	    bool isSettable = false;
 	    bool overwritePrefix = false;
+	    bool isTable = false;       // a TableCallback, which stands for a whole subtree of cells
+	    bool isCell = false;        // one of a TableCallback's cells, only good until the next lookup
+	    SNMPSetValidator validator = 0;             // settable: vets a Set's value before anything is written
+	    bool (*commit)(ValueCallback* callback) = 0; // settable: acts on the value once it's written, false undoes the whole Set
+	    
+	    // brings value up to date before it's read, only function handlers have anything to do
+	    virtual void refresh(){};
 	};
 	
 	class IntegerCallback: public ValueCallback {
@@ -64,12 +130,41 @@
 	  public:
 	    StringCallback(): ValueCallback(STRING){};
 	    char** value;
+	    bool transient = false;     // the string may be overwritten before the response goes out, so it's copied
+	    int length = -1;            // how many bytes value holds when they aren't a null terminated string
+	    unsigned short size = 0;    // settable: how big the buffer value points at is, so a Set can't run past it. 0 if it isn't known, and a Set can't make the string longer
 	};
 	
 	class OIDCallback: public ValueCallback {
 	  public:
 	    OIDCallback(): ValueCallback(ASN_TYPE::OID){};
 	    char* value;
+	    uint32_t* subids = 0;       // value parsed once by setValue(), what a request is answered with
+	    uint8_t subidsLength = 0;
+	    
+	    ~OIDCallback()
+	    {
+	        free(subids);
+	    };
+	    
+	    // point at a new OID string; it's parsed here rather than every time it's read
+	    void setValue(char* oid)
+	    {
+	        value = oid;
+	        free(subids);
+	        subids = 0;
+	        uint32_t parsed[MAX_OID_SUBIDENTIFIERS];
+	        int length = oid ? oid_parse(oid, parsed, MAX_OID_SUBIDENTIFIERS) : -1;
+	        subidsLength = length > 0 ? length : 0;
+	        if(subidsLength){
+	            subids = (uint32_t*)malloc(subidsLength * sizeof(uint32_t));
+	            if(subids){
+	                memcpy(subids, parsed, subidsLength * sizeof(uint32_t));
+	            } else {
+	                subidsLength = 0;
+	            }
+	        }
+	    }
 	};
 	
 	class Counter32Callback: public ValueCallback {
@@ -90,6 +185,79 @@
 	    uint64_t* value;
 	};
 	
+	// A handler whose value comes from calling a function rather than reading a variable. The function
+	// only runs when the OID is asked for, and what it returned is kept for ttl milliseconds however many
+	// managers ask in that time. A ttl of 0 calls it on every read. Captureless lambdas convert to the
+	// function pointer. The result is kept where the plain handler would point, so it reads like one.
+	template <class Callback, typename Value, typename Result = Value>
+	class FunctionCallback: public Callback {
+	  public:
+	    FunctionCallback(Result (*getter)(), unsigned long ttl): getter(getter), ttl(ttl)
+	    {
+	        this->value = &_cached;
+	    };
+	    Result (*getter)();
+	    unsigned long ttl;
+	    
+	    void refresh()
+	    {
+	        unsigned long now = millis();
+	        if(_valid && now - _refreshedAt < ttl){
+	            return;
+	        }
+	        _cached = (Value)getter();
+	        _refreshedAt = now;
+	        _valid = true;
+	    }
+	    
+	    // forces the next read to call the function again
+	    void invalidate()
+	    {
+	        _valid = false;
+	    }
+	    
+	  private:
+	    Value _cached = Value();
+	    unsigned long _refreshedAt = 0;
+	    bool _valid = false;
+	};
+	
+	typedef FunctionCallback<IntegerCallback, int> IntegerFunctionCallback;
+	typedef FunctionCallback<TimestampCallback, int> TimestampFunctionCallback;
+	typedef FunctionCallback<StringCallback, char*, const char*> StringFunctionCallback;
+	typedef FunctionCallback<Counter32Callback, uint32_t> Counter32FunctionCallback;
+	typedef FunctionCallback<Guage32Callback, uint32_t> Guage32FunctionCallback;
+	typedef FunctionCallback<Counter64Callback, uint64_t> Counter64FunctionCallback;
+	
+	// A handler reading an SNMPPublished value. Its group is copied out the first time a request touches
+	// it and that copy serves the rest of the request, so varbinds from one group agree with each other.
+	template <class Callback, typename Value>
+	class PublishedCallback: public Callback {
+	  public:
+	    PublishedCallback(SNMPPublished<Value>* published): published(published)
+	    {
+	        this->value = &published->snapshot;
+	    };
+	    SNMPPublished<Value>* published;
+	    
+	    void refresh()
+	    {
+	        published->group->snapshot(SNMPPublishedGroup::currentRequest());
+	    }
+	};
+	
+	typedef PublishedCallback<IntegerCallback, int> IntegerPublishedCallback;
+	typedef PublishedCallback<TimestampCallback, int> TimestampPublishedCallback;
+	typedef PublishedCallback<Counter32Callback, uint32_t> Counter32PublishedCallback;
+	typedef PublishedCallback<Guage32Callback, uint32_t> Guage32PublishedCallback;
+	typedef PublishedCallback<Counter64Callback, uint64_t> Counter64PublishedCallback;
+	
+	#include "SNMPTable.h"
+	#include "SNMPMIB2.h"
+	#include "SNMPStatic.h"
+	#include "SNMPSet.h"
+	#include "SNMPTemplate.h"
+	
 	typedef struct ValueCallbackList {
 	    ~ValueCallbackList(){
 	        delete next;
@@ -117,6 +285,47 @@
 	    int32_t			sysServices;				/* .1.3.6.1.2.1.1.7.0 */
 	} RFC1213_list;
 	
+	typedef struct SNMPLoopStatsStruct
+	{
+	    unsigned long packets = 0;          // handled by loop() altogether
+	    unsigned long cutShort = 0;         // calls that ran out of budgetMicros while still finding requests queued
+	    uint16_t lastPackets = 0;           // handled by the most recent call
+	    uint16_t mostPackets = 0;           // most handled by any one call
+	} SNMPLoopStats;
+	
+	typedef struct SNMPAgentStatsStruct
+	{
+	    // SNMPv2-MIB's snmp group (RFC 3418), enableStats() puts these under .1.3.6.1.2.1.11
+	    uint32_t inPkts = 0;                // every datagram received, the ones dropped unread included
+	    uint32_t outPkts = 0;               // responses, reports and traps handed to the UDP class
+	    uint32_t inBadVersions = 0;
+	    uint32_t inBadCommunityNames = 0;
+	    uint32_t inASNParseErrs = 0;        // requests that didn't decode
+	    uint32_t inGetRequests = 0;
+	    uint32_t inGetNexts = 0;
+	    uint32_t inSetRequests = 0;
+	    uint32_t inGetResponses = 0;        // managers acknowledging our informs
+	    uint32_t outTooBigs = 0;
+	    uint32_t outNoSuchNames = 0;
+	    uint32_t outBadValues = 0;
+	    uint32_t outGenErrs = 0;
+	    uint32_t outGetResponses = 0;
+	    uint32_t outTraps = 0;              // one per trap or inform per receiver, resends included
+	    uint32_t silentDrops = 0;           // requests that got no answer, one too big to answer even empty among them
+	    
+	    // the agent's own, under the subtree handed to enableStats()
+	    uint32_t inGetBulks = 0;
+	    uint32_t oversizeDrops = 0;         // longer than SNMP_RX_BUFFER_LENGTH, dropped unread
+	    uint32_t sendFailures = 0;          // datagrams the UDP class wouldn't send
+	    uint32_t authFailures = 0;          // unknown communities, and v3 requests the USM turned away
+	    uint32_t requests = 0;              // datagrams read and handled, what the times below are over
+	    uint32_t minMicros = 0;             // from parsing a request to handing the answer to the UDP class
+	    uint32_t averageMicros = 0;
+	    uint32_t maxMicros = 0;
+	    uint64_t totalMicros = 0;
+	    uint32_t peakRequestBytes = 0;      // most memory one request has taken, arena and heap together
+	} SNMPAgentStats;
+	
 	typedef enum 
 	{
 	     SNMP_PERM_NONE,
@@ -126,10 +335,64 @@
 	
 	#include "SNMPTrap.h"
 	
+	typedef struct SNMPTrapQueueStatsStruct
+	{
+	    unsigned long queued = 0;           // traps accepted by queueTrap()
+	    unsigned long coalesced = 0;        // replaced a pending copy of the same trap rather than queueing behind it
+	    unsigned long dropped = 0;          // turned away because the queue was full or the trap wouldn't build
+	    unsigned long sent = 0;             // datagrams, one per trap per receiver
+	    unsigned long failed = 0;           // datagrams the UDP class wouldn't send
+	    uint8_t depth = 0;                  // traps pending right now
+	    uint8_t deepest = 0;
+	    
+	    unsigned long informs = 0;          // informs accepted by queueTrap()
+	    unsigned long informRetries = 0;    // rounds of resending to receivers that hadn't acknowledged
+	    unsigned long acknowledged = 0;     // acknowledgements, one per inform per receiver
+	    unsigned long timedOut = 0;         // receivers that never acknowledged an inform
+	    uint8_t informsPending = 0;
+	} SNMPTrapQueueStats;
+	
+	typedef struct SNMPTrapReceiverStruct
+	{
+	    IPAddress ip;
+	    uint16_t port = 162;
+	    bool used = false;
+	} SNMPTrapReceiver;
+	
+	typedef struct SNMPQueuedTrapStruct
+	{
+	    SNMPTrap* trap = 0;                 // what it was built from, a second copy of the same trap replaces this one
+	    unsigned char* packet = 0;          // encoded once, sent as is to every receiver
+	    unsigned short length = 0;
+	    uint8_t pending = 0;                // receivers still to send to, a bit each
+	} SNMPQueuedTrap;
+	
+	typedef struct SNMPPendingInformStruct
+	{
+	    SNMPTrap* trap = 0;
+	    unsigned char* packet = 0;          // encoded once, resent as is
+	    unsigned short length = 0;
+	    unsigned long requestID = 0;        // what the acknowledgement carries
+	    uint8_t unacknowledged = 0;         // receivers that haven't answered, a bit each
+	    uint8_t due = 0;                    // receivers still to send to in this round
+	    uint8_t attempts = 0;               // rounds so far, the first send included
+	    unsigned long roundStarted = 0;
+	} SNMPPendingInform;
+	
 	class SNMPAgent {
 	    public:
 	        SNMPAgent(){};
 	        SNMPAgent(const char* community): _community(community){};
+	        ~SNMPAgent()
+	        {
+	            _task.stop();
+	            for(int i = 0; i < SNMP_TRAP_QUEUE_LENGTH; i++){
+	                free(_trapQueue[i].packet);
+	            }
+	            for(int i = 0; i < SNMP_INFORM_PENDING; i++){
+	                free(_informs[i].packet);
+	            }
+	        };
 	
 	        void setRWCommunity(const char* readWrite){       // read/write
 	            this->_community = readWrite;
@@ -148,57 +411,238 @@
 	        const char* _readOnlyCommunity = 0;
 	
 	
-	        ValueCallbacks* callbacks = new ValueCallbacks();
-	        ValueCallbacks* callbacksCursor = callbacks;
+	        // every handler, ordered by OID so Get and GetNext are binary searches
+	        ValueCallback** handlers = 0;
+	        int handlerCount = 0;
 	//      bool addHandler(char* OID, SNMPOIDResponse (*callback)(SNMPOIDResponse* response, char* oid));
 	        ValueCallback* findCallback(char* oid, bool next = false);
+	        ValueCallback* findCallback(const uint32_t* oid, int oidLength, bool next = false);
+	        // these and the add*Handler functions below return 0, having freed what they made, if there's no
+	        // memory for the handler or its OID is inside a table's subtree
 	        ValueCallback* addFloatHandler(char* oid, float* value, bool isSettable = false, bool overwritePrefix = false); // this obv just adds integer but with the *0.1 set
-	        ValueCallback* addStringHandler(char*, char**, bool isSettable = false, bool overwritePrefix = false); // passing in a pointer to a char* 
+	        ValueCallback* addStringHandler(char*, char**, bool isSettable = false, bool overwritePrefix = false, unsigned short size = 0); // passing in a pointer to a char*. size is the buffer's, without it a Set can't make the string longer
 	        ValueCallback* addIntegerHandler(char* oid, int* value, bool isSettable = false, bool overwritePrefix = false);
 	        ValueCallback* addTimestampHandler(char* oid, int* value, bool isSettable = false, bool overwritePrefix = false);
 	        ValueCallback* addOIDHandler(char* oid, char* value, bool overwritePrefix = false);
 	        ValueCallback* addCounter64Handler(char* oid, uint64_t* value, bool overwritePrefix = false);
 	        ValueCallback* addCounter32Handler(char* oid, uint32_t* value, bool overwritePrefix = false);
 	        ValueCallback* addGuageHandler(char* oid, uint32_t* value, bool overwritePrefix);
+	        
+	        // read only handlers computed on demand, see FunctionCallback. ttl is in milliseconds
+	        ValueCallback* addIntegerHandler(char* oid, int (*getter)(), unsigned long ttl = 0, bool overwritePrefix = false);
+	        ValueCallback* addTimestampHandler(char* oid, int (*getter)(), unsigned long ttl = 0, bool overwritePrefix = false);
+	        ValueCallback* addStringHandler(char* oid, const char* (*getter)(), unsigned long ttl = 0, bool overwritePrefix = false);
+	        ValueCallback* addCounter32Handler(char* oid, uint32_t (*getter)(), unsigned long ttl = 0, bool overwritePrefix = false);
+	        ValueCallback* addGuageHandler(char* oid, uint32_t (*getter)(), unsigned long ttl = 0, bool overwritePrefix = false);
+	        ValueCallback* addCounter64Handler(char* oid, uint64_t (*getter)(), unsigned long ttl = 0, bool overwritePrefix = false);
+	        
+	        // read only handlers for values published from an interrupt or another task, see SNMPPublished
+	        ValueCallback* addIntegerHandler(char* oid, SNMPPublished<int>* value, bool overwritePrefix = false);
+	        ValueCallback* addTimestampHandler(char* oid, SNMPPublished<int>* value, bool overwritePrefix = false);
+	        ValueCallback* addCounter32Handler(char* oid, SNMPPublished<uint32_t>* value, bool overwritePrefix = false);
+	        ValueCallback* addGuageHandler(char* oid, SNMPPublished<uint32_t>* value, bool overwritePrefix = false);
+	        ValueCallback* addCounter64Handler(char* oid, SNMPPublished<uint64_t>* value, bool overwritePrefix = false);
+	        
+	        // a MIB built into the firmware as a constexpr array, see SNMPStatic.h. It's answered alongside the
+	        // handlers added here, which win where both have the same OID. Its OIDs are used as they are, the
+	        // prefix given to begin() doesn't apply
+	        template <size_t N>
+	        void setStaticMIB(const SNMPStaticEntry (&entries)[N])
+	        {
+	            setStaticMIB(entries, N);
+	        }
+	        void setStaticMIB(const SNMPStaticEntry* entries, uint16_t count);
+	        
+	        // a whole table under its entry OID, add its columns to what comes back. See TableCallback
+	        TableCallback* addTableHandler(char* oid, uint32_t (*rowCount)(), bool overwritePrefix = false);
+	        TableCallback* addTableHandler(char* oid, uint32_t (*nextRow)(uint32_t after), bool overwritePrefix = false);
 	
 	        void setUDP(UDP* udp);
 	        bool begin(uint16_t port = 161);
 	        bool begin(char*, uint16_t port = 161);
 	        void stop();
-	        bool loop();
-	        char oidPrefix[40];
-	        char OIDBuf[MAX_OID_LENGTH];
+	        // handles up to maxPackets queued requests, or as many as arrive within budgetMicros, whichever
+	        // runs out first (0 leaves either unlimited). The default is one packet per call.
+	        bool loop(uint16_t maxPackets = 1, unsigned long budgetMicros = 0);
+	        SNMPLoopStats loopStats;
+	        
+	        // what the agent has received, answered and dropped, and how long requests take. enableStats()
+	        // makes them readable over SNMP: SNMPv2-MIB's snmp group (and usmStats with SNMPv3) where they
+	        // belong, the rest as subtree.1.0 onwards in the order SNMPAgentStats lists them. Without a
+	        // subtree only the standard ones are added
+	        SNMPAgentStats stats;
+	        bool enableStats(const char* subtree = 0);
+	        
+	        // traps sent from loop() rather than there and then: queueTrap() encodes the trap once with its
+	        // values as they are now, and loop() sends it to every receiver a few datagrams at a time. A trap
+	        // queued again before it has gone out to everyone replaces the pending copy. An inform (see
+	        // SNMPTrap::setInform) is sent again by loop() until each receiver has acknowledged it
+	        bool addTrapReceiver(IPAddress ip, uint16_t port = 162);
+	        bool removeTrapReceiver(IPAddress ip, uint16_t port = 162);
+	        bool queueTrap(SNMPTrap* trap);
+	        SNMPTrapQueueStats trapStats;
+	        // one trap to one manager there and then, encoded in the agent's transmit buffer
+	        bool sendTrap(SNMPTrap* trap, IPAddress ip, uint16_t port = 162);
+	        
+	        // how long to wait for an inform's acknowledgement before sending it again, doubled each time,
+	        // and how many times to send it again before giving up on a receiver
+	        void setInformTimeout(unsigned long timeout, uint8_t retries = SNMP_INFORM_RETRIES)
+	        {
+	            _informTimeout = timeout;
+	            _informRetries = retries;
+	        }
+	        
+	#if SNMP_V3
+	        // SNMPv3 users, authenticated with HMAC-SHA and, given a privacy password, encrypted with AES-128.
+	        // Passwords need 8 characters at least. Adding a user hashes a megabyte per password, so do it
+	        // once in setup(); v3().findUser(name)->authKey and ->privKey can be saved and handed to
+	        // addUserWithKeys() next time instead. Without an auth password the user is noAuthNoPriv
+	        bool addUser(const char* name, const char* authPassword, const char* privPassword = 0, bool readWrite = false);
+	        bool addUserWithKeys(const char* name, const unsigned char* authKey, const unsigned char* privKey = 0, bool readWrite = false);
+	        // the engineID managers localize their keys to, a board specific one is made up if it isn't set.
+	        // engineBoots should be kept across restarts and go up by one each time, see SNMPv3Engine
+	        void setEngineID(const unsigned char* id, int length);
+	        void setEngineBoots(uint32_t boots);
+	        SNMPv3Engine& v3()
+	        {
+	            return _v3;
+	        }
+	#endif
+	        
+	        // answer requests from a task of the agent's own, started by begin() and stopped by stop(),
+	        // instead of from loop(). Call before begin(). The task holds the agent's lock while it handles
+	        // a request, so take it with lock()/unlock() around anything that changes a value a handler
+	        // points at, or that sends a trap through the agent's UDP object. Returns false where there are no tasks
+	        bool useTask(int core = SNMP_TASK_CORE, unsigned priority = SNMP_TASK_PRIORITY, uint32_t stackSize = SNMP_TASK_STACK);
+	        // how the task waits when nothing is queued: return once a request is there or timeoutMs have passed.
+	        // Without one it sleeps SNMP_TASK_IDLE_MS between polls, which is as close as the Arduino UDP class gets.
+	        // On the host it blocks on the socket instead
+	        void setTaskWait(void (*wait)(unsigned long timeoutMs))
+	        {
+	            _taskWait = wait;
+	        }
+	        bool taskRunning()
+	        {
+	            return _task.running();
+	        }
+	        void lock()
+	        {
+	            _lock.lock();
+	        }
+	        void unlock()
+	        {
+	            _lock.unlock();
+	        }
+	        char oidPrefix[40] = {0};
 	        bool setOccurred = false;
 	        void resetSetOccurred()
 	        {
 	            setOccurred = false;
 	        }
 	        
-	        UDP* _udp;
+	        UDP* _udp = 0;
 	        bool removeHandler(ValueCallback* callback);
-	        void addHandler(ValueCallback* callback);
+	        bool addHandler(ValueCallback* callback); // false if it couldn't be added, the callback is still the caller's
 	        bool sortHandlers();
 	        
-	        void swap(ValueCallbacks*, ValueCallbacks*);
+	        // registering a large MIB: handlers added between these two are appended unsorted and
+	        // sorted once at the end, instead of each one being inserted in order. false if that found
+	        // handlers inside a table's subtree, which are taken out again (but not deleted)
+	        void beginBulkRegistration(int expectedHandlers = 0);
+	        bool endBulkRegistration();
 	        
-	        // automatically enables and adds RFC1213 "System" variables. provide a 
-	        void enableRFC1213()
-	        { 
-						/////
+	        // how much of the per-request arena the largest request so far has used, and how often
+	        // a request outgrew it. Raise SNMP_ARENA_SIZE if arena().totalSpills keeps going up
+	        SNMPArena& arena()
+	        {
+	            return _arena;
+	        }
+	        
+	        // how often a repeated Get was answered from a remembered template, see SNMPTemplate.h
+	        SNMPTemplateStats& templateStats()
+	        {
+	            return _templates.stats;
+	        }
+	        
+	        // adds MIB-II's system group (RFC 1213) and, given a provider, its interfaces group. sysUpTime counts
+	        // hundredths of a second off millis(). Read/write managers can set sysContact, sysName and sysLocation,
+	        // up to SNMP_SYSTEM_STRING_LENGTH - 1 characters, which land in systemGroup for the sketch to keep
+	        bool enableRFC1213(const char* sysDescr = "Arduino_SNMP", const char* sysObjectID = ".0.0", SNMPInterfaceProvider* interfaces = 0);
+	        void setSystemStrings(const char* contact, const char* name, const char* location);
+	        SNMPSystemGroup systemGroup;
+	        // what sysUpTime reads, for SNMPTrap::setUptimeCallback(). 0 until enableRFC1213()
+	        TimestampCallback* sysUpTime()
+	        {
+	            return _uptime;
 	        }
 	        
 	    private:
-	        bool sort_oid(char*, char*);
-	        unsigned char _packetBuffer[SNMP_PACKET_LENGTH*3];
+	        uint32_t _oidPrefix[20];
+	        uint8_t _oidPrefixLength = 0;
+	        bool resolveOID(ValueCallback* callback);
+	        ValueCallback* addHandler(char* oid, ValueCallback* callback, bool overwritePrefix); // copies the OID in and adds it
+	        ValueCallback* addOwnedHandler(ValueCallback* callback);
+	        static void releaseOID(ValueCallback* callback);
+	        int _handlerCapacity = 0;
+	        bool _handlersSorted = true;
+	        bool _bulkRegistration = false;
+	        bool reserveHandlers(int capacity);
+	        int findHandlerIndex(const uint32_t* oid, int oidLength, bool after);
+	        ValueCallback* findHandler(const uint32_t* oid, int oidLength, bool next);
+	        SNMPStaticMIB _staticMIB;
+	        static int compareHandlers(const void* one, const void* two);
+	        static bool insideTable(ValueCallback* table, ValueCallback* callback);
+	        
+	        SNMPMutex _lock; // held while a request is handled and while the handler list changes
+	        SNMPTask _task;
+	        bool _useTask = false;
+	        void (*_taskWait)(unsigned long timeoutMs) = 0;
+	        int _taskCore = SNMP_TASK_CORE;
+	        unsigned _taskPriority = SNMP_TASK_PRIORITY;
+	        uint32_t _taskStack = SNMP_TASK_STACK;
+	        static void taskMain(void* agent);
+	        
+	        SNMPTrapReceiver _trapReceivers[SNMP_TRAP_RECEIVERS];
+	        SNMPQueuedTrap _trapQueue[SNMP_TRAP_QUEUE_LENGTH];
+	        uint8_t _trapQueueHead = 0;
+	        uint8_t trapReceivers();
+	        unsigned char* encodeTrap(SNMPTrap* trap, int* length);
+	        int sendQueuedTraps(int budget);
+	        
+	        SNMPPendingInform _informs[SNMP_INFORM_PENDING];
+	        unsigned long _informRequestID = 0;
+	        unsigned long _informTimeout = SNMP_INFORM_TIMEOUT;
+	        uint8_t _informRetries = SNMP_INFORM_RETRIES;
+	        bool queueInform(SNMPTrap* trap, uint8_t receivers);
+	        int sendInforms(int budget);
+	        unsigned long informTimeout(uint8_t attempts);
+	        bool acknowledgeInform(SNMPRequest* response, IPAddress ip, uint16_t port);
+	        
+	        unsigned char _rxBuffer[SNMP_RX_BUFFER_LENGTH];
+	        unsigned char _txBuffer[SNMP_TX_BUFFER_LENGTH];
+	        SNMPArena _arena; // backs every object built while answering a request
+	        uint32_t _request = 0;            // the request or trap being answered or built, see SNMPPublishedGroup::newRequest()
+	        SNMPResponseTemplates _templates; // repeated Gets, cleared whenever the handlers change
+	        UptimeCallback* _uptime = 0;
+	        char* _systemStrings[3];          // what the sysContact, sysName and sysLocation handlers point at
+	#if SNMP_V3
+	        SNMPv3Engine _v3;
+	        bool sendReport(SNMPv3Message* message);
+	#endif
+	        int serialiseTemplate(SNMPResponseTemplate* entry, SNMPRequest* request, BERWriter& writer);
+	        int responseLimit(SNMPResponse* response);
 	        bool inline receivePacket(int length);
 	        
 	        bool parsePacket(int len);
+	        bool handleBulkRequest(SNMPRequest* request, SNMPResponse* response);
+	        bool handleSetRequest(SNMPRequest* request, SNMPResponse* response, bool writable);
+	        BER_CONTAINER* readValue(ValueCallback* callback);
 	    		void printPacket(int len);
 	    		
-	        SNMPOIDResponse* generateErrorResponse(ERROR_STATUS error, char* oid)
+	        SNMPOIDResponse* generateErrorResponse(ERROR_STATUS error, const uint32_t* oid, int oidLength)
 	        {
 	            SNMPOIDResponse* errorResponse = new SNMPOIDResponse();
-	            errorResponse->oid = new OIDType(oid);
+	            errorResponse->oid = new OIDType(oid, oidLength);
 	            errorResponse->errorStatus = error;
 	            errorResponse->value = new NullType();
 	            errorResponse->type = NULLTYPE;
@@ -218,17 +662,32 @@
 	{
 	    if(!_udp) return false;
 	    _udp->begin(port);
+	    if(_useTask && !_task.running()){
+	        return _task.start(taskMain, this, "snmp", _taskStack, _taskPriority, _taskCore);
+	    }
 	    return true;
 	}
 	
 	bool SNMPAgent::begin(char* prefix, uint16_t port)
 	{
-	    strncpy(oidPrefix, prefix, 40);
+	    strncpy(oidPrefix, prefix, 39);
+	    int length = oid_parse(oidPrefix, _oidPrefix, 20);
+	    _oidPrefixLength = length > 0 ? length : 0;
+	    
+	    // anything registered before we knew the prefix has to be matched against the new one
+	    SNMPMutexGuard guard(_lock);
+	    for(int i = 0; i < handlerCount; i++){
+	        resolveOID(handlers[i]);
+	    }
+	    // only handlers without overwritePrefix moved, so the order may have changed
+	    _handlersSorted = false;
+	    sortHandlers();
 	    return this->begin(port);
 	}
 	
 	void SNMPAgent::stop()
 	{
+	    _task.stop();
 	    if(_udp)
 	    {
 	        _udp->stop();
@@ -236,13 +695,399 @@
 	    _udp = 0;
 	}
 	
-	bool SNMPAgent::loop()
+	bool SNMPAgent::loop(uint16_t maxPackets, unsigned long budgetMicros)
 	{
 	    if(!_udp)
 	    {
 	        return false;
 	    }
-	    return receivePacket(_udp->parsePacket());
+	    
+	    // stop as soon as nothing is queued, parsePacket() doesn't block
+	    SNMPMutexGuard guard(_lock);
+	    unsigned long started = budgetMicros ? micros() : 0;
+	    uint16_t handled = 0;
+	    while(true){
+	        int packetLength = _udp->parsePacket();
+	        if(!packetLength){
+	            break;
+	        }
+	        receivePacket(packetLength);
+	        handled++;
+	        if(maxPackets && handled >= maxPackets){
+	            break; // as many as the caller asked for, not a sign of falling behind
+	        }
+	        if(budgetMicros && micros() - started >= budgetMicros){
+	            // parsePacket() can't look ahead without taking the next packet off the socket, so
+	            // only running out of time counts, with requests coming in faster than they're answered
+	            loopStats.cutShort++;
+	            break;
+	        }
+	    }
+	    
+	    loopStats.packets += handled;
+	    loopStats.lastPackets = handled;
+	    if(handled > loopStats.mostPackets){
+	        loopStats.mostPackets = handled;
+	    }
+	    
+	    if(_uptime){
+	        _uptime->tick(); // catches millis() wrapping even when nobody asks for sysUpTime
+	    }
+	    
+	    // true while traps are still going out too, so the task doesn't sleep on them
+	    int trapsSent = sendQueuedTraps(SNMP_TRAP_SENDS_PER_LOOP);
+	    trapsSent += sendInforms(SNMP_TRAP_SENDS_PER_LOOP - trapsSent);
+	    return handled > 0 || trapsSent > 0;
+	}
+	
+	bool SNMPAgent::addTrapReceiver(IPAddress ip, uint16_t port)
+	{
+	    SNMPMutexGuard guard(_lock);
+	    int slot = -1;
+	    for(int i = 0; i < SNMP_TRAP_RECEIVERS; i++){
+	        if(_trapReceivers[i].used && _trapReceivers[i].ip == ip && _trapReceivers[i].port == port){
+	            return true;
+	        }
+	        if(!_trapReceivers[i].used && slot < 0){
+	            slot = i;
+	        }
+	    }
+	    if(slot < 0){
+	        return false;
+	    }
+	    _trapReceivers[slot].ip = ip;
+	    _trapReceivers[slot].port = port;
+	    _trapReceivers[slot].used = true;
+	    return true;
+	}
+	
+	bool SNMPAgent::removeTrapReceiver(IPAddress ip, uint16_t port)
+	{
+	    SNMPMutexGuard guard(_lock);
+	    for(int i = 0; i < SNMP_TRAP_RECEIVERS; i++){
+	        if(_trapReceivers[i].used && _trapReceivers[i].ip == ip && _trapReceivers[i].port == port){
+	            _trapReceivers[i].used = false;
+	            // nothing still queued goes to it, the traps owed to nobody else are dropped by the next send
+	            for(int k = 0; k < SNMP_TRAP_QUEUE_LENGTH; k++){
+	                _trapQueue[k].pending &= ~(1 << i);
+	            }
+	            for(int k = 0; k < SNMP_INFORM_PENDING; k++){
+	                _informs[k].unacknowledged &= ~(1 << i);
+	                _informs[k].due &= ~(1 << i);
+	            }
+	            return true;
+	        }
+	    }
+	    return false;
+	}
+	
+	uint8_t SNMPAgent::trapReceivers()
+	{
+	    uint8_t receivers = 0;
+	    for(int i = 0; i < SNMP_TRAP_RECEIVERS; i++){
+	        if(_trapReceivers[i].used){
+	            receivers |= 1 << i;
+	        }
+	    }
+	    return receivers;
+	}
+	
+	unsigned char* SNMPAgent::encodeTrap(SNMPTrap* trap, int* length)
+	{
+	    // measured first, so it's encoded straight into a block of the right size
+	    unsigned char* packet = 0;
+	    _request = SNMPPublishedGroup::newRequest();
+	    if(trap->build()){
+	        BERWriter counter;
+	        *length = trap->packet->serialise(counter);
+	        packet = (unsigned char*)malloc(*length);
+	        if(packet){
+	            BERWriter writer(packet, *length);
+	            trap->packet->serialise(writer);
+	        }
+	    }
+	    delete trap->packet;
+	    trap->packet = 0;
+	    return packet;
+	}
+	
+	bool SNMPAgent::queueTrap(SNMPTrap* trap)
+	{
+	    SNMPMutexGuard guard(_lock);
+	    uint8_t receivers = trapReceivers();
+	    if(!receivers){
+	        return false;
+	    }
+	    if(trap->inform && trap->version2){
+	        return queueInform(trap, receivers);
+	    }
+	    
+	    int length = 0;
+	    unsigned char* packet = encodeTrap(trap, &length);
+	    if(!packet){
+	        trapStats.dropped++;
+	        return false;
+	    }
+	    
+	    // a copy of this trap that hasn't gone to everyone yet is out of date now, this one takes its place
+	    for(int i = 0; i < trapStats.depth; i++){
+	        SNMPQueuedTrap* entry = &_trapQueue[(_trapQueueHead + i) % SNMP_TRAP_QUEUE_LENGTH];
+	        if(entry->trap == trap){
+	            free(entry->packet);
+	            entry->packet = packet;
+	            entry->length = length;
+	            entry->pending = receivers;
+	            trapStats.coalesced++;
+	            return true;
+	        }
+	    }
+	    
+	    if(trapStats.depth == SNMP_TRAP_QUEUE_LENGTH){
+	        free(packet);
+	        trapStats.dropped++;
+	        return false;
+	    }
+	    SNMPQueuedTrap* entry = &_trapQueue[(_trapQueueHead + trapStats.depth) % SNMP_TRAP_QUEUE_LENGTH];
+	    entry->trap = trap;
+	    entry->packet = packet;
+	    entry->length = length;
+	    entry->pending = receivers;
+	    trapStats.depth++;
+	    trapStats.queued++;
+	    if(trapStats.depth > trapStats.deepest){
+	        trapStats.deepest = trapStats.depth;
+	    }
+	    return true;
+	}
+	
+	bool SNMPAgent::sendTrap(SNMPTrap* trap, IPAddress ip, uint16_t port)
+	{
+	    // the transmit buffer is shared with requests, which may be answered from the agent's task
+	    SNMPMutexGuard guard(_lock);
+	    int length = 0;
+	    _request = SNMPPublishedGroup::newRequest();
+	    if(_udp && trap->build()){
+	        BERWriter writer(_txBuffer, SNMP_TX_BUFFER_LENGTH);
+	        length = trap->packet->serialise(writer);
+	        if(writer.overflow){
+	            length = 0;
+	        }
+	        if(length){
+	            _udp->beginPacket(ip, port);
+	            _udp->write(writer.data(), length);
+	            if(!_udp->endPacket()){
+	                stats.sendFailures++;
+	                length = 0;
+	            }
+	        }
+	    }
+	    delete trap->packet;
+	    trap->packet = 0;
+	    if(!length){
+	        return false;
+	    }
+	    stats.outPkts++;
+	    stats.outTraps++;
+	    return true;
+	}
+	
+	int SNMPAgent::sendQueuedTraps(int budget)
+	{
+	    int sent = 0;
+	    while(trapStats.depth && sent < budget){
+	        SNMPQueuedTrap* entry = &_trapQueue[_trapQueueHead];
+	        for(int i = 0; i < SNMP_TRAP_RECEIVERS && sent < budget; i++){
+	            if(!(entry->pending & (1 << i))){
+	                continue;
+	            }
+	            entry->pending &= ~(1 << i);
+	            _udp->beginPacket(_trapReceivers[i].ip, _trapReceivers[i].port);
+	            _udp->write(entry->packet, entry->length);
+	            if(_udp->endPacket()){
+	                trapStats.sent++;
+	                stats.outPkts++;
+	                stats.outTraps++;
+	            } else {
+	                trapStats.failed++;
+	                stats.sendFailures++;
+	            }
+	            sent++;
+	        }
+	        if(entry->pending){
+	            break; // out of budget, the rest of its receivers get it next time
+	        }
+	        free(entry->packet);
+	        *entry = SNMPQueuedTrap();
+	        _trapQueueHead = (_trapQueueHead + 1) % SNMP_TRAP_QUEUE_LENGTH;
+	        trapStats.depth--;
+	    }
+	    return sent;
+	}
+	
+	bool SNMPAgent::queueInform(SNMPTrap* trap, uint8_t receivers)
+	{
+	    // a new request-id every time, so a late acknowledgement of the copy this replaces doesn't count
+	    trap->requestID = ++_informRequestID & 0x7FFFFFFF;
+	    int length = 0;
+	    unsigned char* packet = encodeTrap(trap, &length);
+	    if(!packet){
+	        trapStats.dropped++;
+	        return false;
+	    }
+	    
+	    SNMPPendingInform* entry = 0;
+	    for(int i = 0; i < SNMP_INFORM_PENDING; i++){
+	        if(_informs[i].packet && _informs[i].trap == trap){
+	            entry = &_informs[i];
+	            free(entry->packet);
+	            trapStats.coalesced++;
+	            break;
+	        }
+	        if(!_informs[i].packet && !entry){
+	            entry = &_informs[i];
+	        }
+	    }
+	    if(!entry){
+	        free(packet);
+	        trapStats.dropped++;
+	        return false;
+	    }
+	    if(!entry->packet){
+	        trapStats.informsPending++;
+	        trapStats.informs++;
+	    }
+	    entry->trap = trap;
+	    entry->packet = packet;
+	    entry->length = length;
+	    entry->requestID = trap->requestID;
+	    entry->unacknowledged = receivers;
+	    entry->due = receivers;
+	    entry->attempts = 1;
+	    entry->roundStarted = millis();
+	    return true;
+	}
+	
+	int SNMPAgent::sendInforms(int budget)
+	{
+	    int sent = 0;
+	    unsigned long now = millis();
+	    for(int i = 0; i < SNMP_INFORM_PENDING; i++){
+	        SNMPPendingInform* entry = &_informs[i];
+	        if(!entry->packet){
+	            continue;
+	        }
+	        
+	        // a round is over once everyone in it has been sent to and the timeout, doubled for every resend, has passed
+	        if(!entry->due && now - entry->roundStarted >= informTimeout(entry->attempts)){
+	            if(!entry->unacknowledged || entry->attempts > _informRetries){
+	                for(int k = 0; k < SNMP_TRAP_RECEIVERS; k++){
+	                    if(entry->unacknowledged & (1 << k)){
+	                        trapStats.timedOut++;
+	                    }
+	                }
+	                free(entry->packet);
+	                *entry = SNMPPendingInform();
+	                trapStats.informsPending--;
+	                continue;
+	            }
+	            entry->attempts++;
+	            entry->due = entry->unacknowledged;
+	            entry->roundStarted = now;
+	            trapStats.informRetries++;
+	        }
+	        
+	        for(int k = 0; k < SNMP_TRAP_RECEIVERS && sent < budget; k++){
+	            if(!(entry->due & (1 << k))){
+	                continue;
+	            }
+	            entry->due &= ~(1 << k);
+	            _udp->beginPacket(_trapReceivers[k].ip, _trapReceivers[k].port);
+	            _udp->write(entry->packet, entry->length);
+	            if(_udp->endPacket()){
+	                trapStats.sent++;
+	                stats.outPkts++;
+	                stats.outTraps++;
+	            } else {
+	                trapStats.failed++;
+	                stats.sendFailures++;
+	            }
+	            sent++;
+	        }
+	    }
+	    return sent;
+	}
+	
+	unsigned long SNMPAgent::informTimeout(uint8_t attempts)
+	{
+	    // doubled a round at a time rather than shifted, so any number of retries stays defined
+	    unsigned long timeout = _informTimeout;
+	    for(uint8_t i = 1; i < attempts && timeout < SNMP_INFORM_MAX_TIMEOUT; i++){
+	        timeout *= 2;
+	    }
+	    return MIN(timeout, (unsigned long)SNMP_INFORM_MAX_TIMEOUT);
+	}
+	
+	bool SNMPAgent::acknowledgeInform(SNMPRequest* response, IPAddress ip, uint16_t port)
+	{
+	    for(int i = 0; i < SNMP_INFORM_PENDING; i++){
+	        SNMPPendingInform* entry = &_informs[i];
+	        if(!entry->packet || entry->requestID != response->requestID){
+	            continue;
+	        }
+	        // the manager echoes the inform's community, which is read back out of the packet as it was sent
+	        BERView view, community;
+	        BERReader packet(entry->packet, entry->length);
+	        if(!packet.expect(STRUCTURE, view)){
+	            return false;
+	        }
+	        BERReader fields(view);
+	        if(!fields.expect(INTEGER, view) || !fields.expect(STRING, community)
+	            || community.length != response->communityLength || memcmp(community.value, response->communityString, community.length)){
+	            return false;
+	        }
+	        for(int k = 0; k < SNMP_TRAP_RECEIVERS; k++){
+	            if((entry->unacknowledged & (1 << k)) && _trapReceivers[k].ip == ip && _trapReceivers[k].port == port){
+	                entry->unacknowledged &= ~(1 << k);
+	                entry->due &= ~(1 << k);
+	                trapStats.acknowledged++;
+	            }
+	        }
+	        if(!entry->unacknowledged){
+	            free(entry->packet);
+	            *entry = SNMPPendingInform();
+	            trapStats.informsPending--;
+	        }
+	        return true;
+	    }
+	    return false;
+	}
+	
+	bool SNMPAgent::useTask(int core, unsigned priority, uint32_t stackSize)
+	{
+	    _useTask = SNMP_HAS_TASKS;
+	    _taskCore = core;
+	    _taskPriority = priority;
+	    _taskStack = stackSize;
+	    return _useTask;
+	}
+	
+	void SNMPAgent::taskMain(void* agent)
+	{
+	    SNMPAgent* self = (SNMPAgent*)agent;
+	    while(!self->_task.stopping()){
+	        // the lock is let go between turns, so the sketch never waits more than one burst for it
+	        if(!self->loop(SNMP_TASK_BURST)){
+	            if(self->_taskWait){
+	                self->_taskWait(SNMP_TASK_WAIT_MS);
+	#if !defined(ARDUINO)
+	            } else if(self->_udp && self->_udp->waitForPacket(SNMP_TASK_WAIT_MS)){
+	                // the host's UDP can be blocked on, the Arduino class can't
+	#endif
+	            } else {
+	                SNMPTask::sleep(SNMP_TASK_IDLE_MS);
+	            }
+	        }
+	    }
 	}
 	
 	void SNMPAgent::printPacket(int len)
@@ -251,214 +1096,267 @@
 	    Snmp_Serial_print(F("[DEBUG SNMP] packet: "));
 	    for (int i = 0; i < len; i++)
 	    {
-	        Snmp_Serial_printf("%02x ", _packetBuffer[i]);
+	        Snmp_Serial_printf("%02x ", _rxBuffer[i]);
 	    }
 	    Snmp_Serial_println();
+	  #else
+	    (void)len;
 	  #endif
 	}
 	
 	bool inline SNMPAgent::receivePacket(int packetLength)
 	{
 	   if(!packetLength) 		return false;
+	   stats.inPkts++;
 	   
 	   Snmp_Serial_print(F("[DEBUG SNMP] Packet Length: "));
 	   Snmp_Serial_print(packetLength);
 	   Snmp_Serial_print(F("  From Address: "));
 	   Snmp_Serial_println(_udp->remoteIP());
 	   
-	   if(packetLength < 0 || packetLength > SNMP_PACKET_LENGTH){
+	   if(packetLength < 0 || packetLength > SNMP_RX_BUFFER_LENGTH){
 	       Snmp_Serial_println(F("[DEBUG SNMP] dropping packet"));
+	       _udp->flush();
+	       stats.oversizeDrops++;
 	       return false;
 	   }
 	   
-	    memset(_packetBuffer, 0, SNMP_PACKET_LENGTH*3);
-	    int len = packetLength;
-	    _udp->read(_packetBuffer, MIN(len, SNMP_PACKET_LENGTH));
+	    // the request is parsed by length, nothing past what was read is ever looked at
+	    int len = _udp->read(_rxBuffer, packetLength);
 	    _udp->flush();
-	    _packetBuffer[len] = 0;		// null terminate the buffer
+	    if(len <= 0)			return false;
 	    
 	    printPacket(len);
 			
-	    return parsePacket(len);
+	    unsigned long started = micros();
+	    bool handled = parsePacket(len);
+	    uint32_t elapsed = micros() - started;
+	    stats.requests++;
+	    stats.totalMicros += elapsed;
+	    stats.averageMicros = stats.totalMicros / stats.requests;
+	    if(stats.requests == 1 || elapsed < stats.minMicros){
+	        stats.minMicros = elapsed;
+	    }
+	    if(elapsed > stats.maxMicros){
+	        stats.maxMicros = elapsed;
+	    }
+	    stats.peakRequestBytes = _arena.peakRequest; // the arena was emptied on the way out of parsePacket
+	    return handled;
 	}
 	
 	bool SNMPAgent::parsePacket(int len)
 	{
-	    SNMPRequest* snmprequest = new SNMPRequest();
-	    if(snmprequest->parseFrom(_packetBuffer)){
-	       
-	        // check version and community
-	        SNMP_PERMISSION requestPermission = SNMP_PERM_NONE;
-	
-	        if(_readOnlyCommunity != 0 && strcmp(_readOnlyCommunity, snmprequest->communityString) == 0) { // snmprequest->version != 1
-	            requestPermission = SNMP_PERM_READ_ONLY;
+	    // the response and everything hanging off it come out of the arena, emptied when we return
+	    SNMPArenaScope arenaScope(&_arena);
+	    _request = SNMPPublishedGroup::newRequest(); // published values and interface rows are read at most once from here on
+	    SNMPRequest snmprequest;
+	#if SNMP_V3
+	    // a v3 request is authenticated and decrypted in place before the PDU inside it is read
+	    SNMPv3Message v3;
+	    bool parsed;
+	    if(SNMPv3Engine::isV3(_rxBuffer, len)){
+	        SNMPv3Status status = _v3.receive(_rxBuffer, len, &v3);
+	        if(v3.report && v3.report != 2 && v3.report != 4){
+	            stats.authFailures++; // the other two are managers finding out the engineID and catching up with its clock
 	        }
-	
-	        if(strcmp(_community, snmprequest->communityString) == 0) { // snmprequest->version != 1
-	            requestPermission = SNMP_PERM_READ_WRITE;
+	        if(status == SNMP_V3_REPORT){
+	            return sendReport(&v3);
 	        }
-	
-	        if(requestPermission == SNMP_PERM_NONE){
-	            Snmp_Serial_println(F("[DEBUG SNMP] Invalid permissions"));
-	            delete snmprequest;
+	        if(v3.report){
+	            stats.silentDrops++; // a Report was due, but the manager didn't ask for one
 	            return false;
 	        }
+	        parsed = status == SNMP_V3_OK && snmprequest.parseScopedPDU(v3.scopedPDU);
+	    } else {
+	        parsed = snmprequest.parseFrom(_rxBuffer, len);
+	    }
+	    if(parsed){
+	#else
+	    if(snmprequest.parseFrom(_rxBuffer, len)){
+	#endif
+	        
+	        // v1 and v2c go by community, v3 by the USM above
+	        bool knownVersion = snmprequest.version == 1 || snmprequest.version == 2;
+	#if SNMP_V3
+	        knownVersion = knownVersion || v3.user;
+	#endif
+	        if(!knownVersion){
+	            Snmp_Serial_println(F("[DEBUG SNMP] Unknown SNMP version"));
+	            stats.inBadVersions++;
+	            return false;
+	        }
+	        
+	        switch(snmprequest.requestType){
+	            case GetRequestPDU:     stats.inGetRequests++;  break;
+	            case GetNextRequestPDU: stats.inGetNexts++;     break;
+	            case GetBulkRequestPDU: stats.inGetBulks++;     break;
+	            case SetRequestPDU:     stats.inSetRequests++;  break;
+	            case GetResponsePDU:    stats.inGetResponses++; break;
+	            default: break;
+	        }
+	        
+	        // check version and community
+	        SNMP_PERMISSION requestPermission = SNMP_PERM_NONE;
+	
+	        if(_readOnlyCommunity != 0 && snmprequest.communityMatches(_readOnlyCommunity)) { // snmprequest.version != 1
+	            requestPermission = SNMP_PERM_READ_ONLY;
+	        }
+	
+	        if(snmprequest.communityMatches(_community)) { // snmprequest.version != 1
+	            requestPermission = SNMP_PERM_READ_WRITE;
+	        }
+	#if SNMP_V3
+	        if(v3.user){
+	            requestPermission = v3.user->readWrite ? SNMP_PERM_READ_WRITE : SNMP_PERM_READ_ONLY;
+	        }
+	#endif
+	
+	        // a manager acknowledging one of our informs, there's nothing to answer. It carries the inform's
+	        // community rather than one of ours, and only counts if that matches
+	        if(snmprequest.requestType == GetResponsePDU){
+	            if(!acknowledgeInform(&snmprequest, _udp->remoteIP(), _udp->remotePort())){
+	                Snmp_Serial_println(F("[DEBUG SNMP] Response to no inform of ours"));
+	                stats.silentDrops++;
+	            }
+	            return true;
+	        }
+	
+	        if(requestPermission == SNMP_PERM_NONE){
+	            Snmp_Serial_println(F("[DEBUG SNMP] Invalid permissions"));
+	            stats.inBadCommunityNames++;
+	            stats.authFailures++;
+	            return false;
+	        }
+	        
+	        SNMPResponse* response = new SNMPResponse();
+	        
+	        response->requestID = snmprequest.requestID;
+	        response->version = snmprequest.version - 1;
+	        int communityLength = MIN(snmprequest.communityLength, sizeof(response->communityString) - 1);
+	        memcpy(response->communityString, snmprequest.communityString, communityLength);
+	        response->communityString[communityLength] = 0;
+	#if SNMP_V3
+	        if(v3.user){
+	            response->v3 = &v3;
+	        }
+	#endif
+	        
+	        if(snmprequest.requestType == GetBulkRequestPDU){
+	            if(!handleBulkRequest(&snmprequest, response)){
+	                stats.silentDrops++;
+	                delete response;
+	                return false;
+	            }
+	        }
+	        if(snmprequest.requestType == SetRequestPDU){
+	            if(!handleSetRequest(&snmprequest, response, requestPermission == SNMP_PERM_READ_WRITE)){
+	                stats.silentDrops++;
+	                delete response;
+	                return false;
+	            }
+	        }
+	        
+	        // a Get we've answered before already knows its handlers
+	        SNMPResponseTemplate* cached = 0;
+	        ValueCallback* resolved[SNMP_TEMPLATE_VARBINDS];
+	        bool cacheable = false;
+	        if(snmprequest.requestType == GetRequestPDU){
+	            cached = _templates.find(&snmprequest);
+	            cacheable = !cached && snmprequest.varBindCount <= SNMP_TEMPLATE_VARBINDS;
+	        }
 	        
-	        SNMPResponse* response = new SNMPResponse();
-	        
-	        response->requestID = snmprequest->requestID;
-	        response->version = snmprequest->version - 1;
-	        strncpy(response->communityString, snmprequest->communityString, 15);
-	        
 	        int varBindIndex = 1;
-	        snmprequest->varBindsCursor = snmprequest->varBinds;
-	        while(true){
-	            Snmp_Serial_print(F("[DEBUG SNMP] OID: "));    Snmp_Serial_print(snmprequest->varBindsCursor->value->oid->_value);
-	        		Snmp_Serial_print(F("  Version: "));		Snmp_Serial_println(snmprequest->version -1);
+	        VarBind varbind;
+	        uint32_t requestOID[MAX_OID_SUBIDENTIFIERS];
+	        while(!cached && snmprequest.requestType != GetBulkRequestPDU && snmprequest.requestType != SetRequestPDU && snmprequest.nextVarBind(varbind)){
+	            int requestOIDLength = BERReader::readOID(varbind.oid, requestOID, MAX_OID_SUBIDENTIFIERS);
+	            if(requestOIDLength < 0){
+	                Snmp_Serial_println(F("[DEBUG SNMP] OID too long or malformed, dropping packet"));
+	                stats.silentDrops++;
+	                delete response;
+	                return false;
+	            }
+	            
+	            #if (SNMP_DEBUG == 1)
+	            char debugOID[MAX_OID_LENGTH];
+	            oid_format(requestOID, requestOIDLength, debugOID, MAX_OID_LENGTH);
+	            Snmp_Serial_print(F("[DEBUG SNMP] OID: "));    Snmp_Serial_print(debugOID);
+	        		Snmp_Serial_print(F("  Version: "));		Snmp_Serial_println(snmprequest.version -1);
+	            #endif
 	            
 	            // Deal with OID request here:
 	            bool walk = false;
-	            if(snmprequest->requestType == GetNextRequestPDU){
+	            if(snmprequest.requestType == GetNextRequestPDU){
 	                walk = true;
 	            }
 	            
-	            ValueCallback* callback = findCallback(snmprequest->varBindsCursor->value->oid->_value, walk);
+	            ValueCallback* callback = findCallback(requestOID, requestOIDLength, walk);
+	            if(cacheable){
+	                // a table's cells are looked up afresh every time
+	                cacheable = callback && !callback->isCell;
+	                resolved[varBindIndex - 1] = callback;
+	            }
 	            if(callback){ // this is where we deal with the response varbind
-	                SNMPOIDResponse* OIDResponse = new SNMPOIDResponse();
-	                OIDResponse->errorStatus = (ERROR_STATUS)0;
-	                
-	                memset(OIDBuf, 0, MAX_OID_LENGTH);
-	                if(!callback->overwritePrefix){
-	                    strcat(OIDBuf, oidPrefix);
-	                }
-	                
-	                strcat(OIDBuf, callback->OID);
-	                
-	                OIDResponse->oid = new OIDType(OIDBuf);
-	                OIDResponse->type = callback->type;
-	                
 	                // TODO: this whole thing needs better flow: proper checking for errors etc.
 	                
-	                if(snmprequest->requestType == SetRequestPDU){
-	                    // settable data..
-	                    if(callback->isSettable){
-	                        if(requestPermission == SNMP_PERM_READ_ONLY){ // community is readOnly
-	                            Snmp_Serial_println(F("[DEBUG SNMP] READONLY COMMUNITY USED")); 
-	                            SNMPOIDResponse* errorResponse = generateErrorResponse(NO_ACCESS, snmprequest->varBindsCursor->value->oid->_value);
-	
-	                            
-	                        	response->addErrorResponse(errorResponse, varBindIndex);
-	                        } else {
-	                            if(callback->type != snmprequest->varBindsCursor->value->type){
-	                                // wrong data type to set..
-	                                // BAD_VALUE
-	                                Snmp_Serial_println(F("[DEBUG SNMP] VALUE-TYPE DOES NOT MATCH")); 
-	                                SNMPOIDResponse* errorResponse = generateErrorResponse(BAD_VALUE, snmprequest->varBindsCursor->value->oid->_value);
-	                        
-	                        	response->addErrorResponse(errorResponse, varBindIndex);
-	                            } else {
-	                                // actually set it
-	                                switch(callback->type){
-	                                    case STRING:
-	                                        {
-	                                            /* SHN */
-	                                            //memcpy(*((StringCallback*)callback)->value, String(((OctetType*)snmprequest->varBindsCursor->value->value)->_value).c_str(), 32);// FIXME: this is VERY dangerous, i'm assuming the length of the source char*, this needs to change. for some reason strncpy didnd't work, need to look into this. the '25' also needs to be defined somewhere so this won't break;
-	                                            //*(*((StringCallback*)callback)->value + 31) = 0x0; // close off the dest string, temporary
-	                                            //OctetType* value = new OctetType(*((StringCallback*)callback)->value);
-	                                            //OIDResponse->value = value;
-	                                            strncpy(*((StringCallback *)callback)->value, String(((OctetType*)snmprequest->varBindsCursor->value->value)->_value).c_str(), strlen(((OctetType*)snmprequest->varBindsCursor->value->value)->_value));
-	                                            OctetType* value = new OctetType(*((StringCallback*)callback)->value);
-	                                            OIDResponse->value = value;
-	                                            setOccurred = true;
-	                                        }
-	                                    break;
-	                                    case INTEGER:
-	                                        {
-	                                            IntegerType* value = new IntegerType();
-	                                            if(!((IntegerCallback*)callback)->isFloat){
-	                                                *(((IntegerCallback*)callback)->value) = ((IntegerType*)snmprequest->varBindsCursor->value->value)->_value;
-	                                                value->_value = *(((IntegerCallback*)callback)->value);
-	                                            } else {
-	                                                *(((IntegerCallback*)callback)->value) = (float)(((IntegerType*)snmprequest->varBindsCursor->value->value)->_value / 10);
-	                                                value->_value = *(float*)(((IntegerCallback*)callback)->value) * 10;
-	                                            }
-	                                            OIDResponse->value = value;
-	                                            setOccurred = true;
-	                                        }
-	                                    break;
-	                                }
-	                                	response->addResponse(OIDResponse);
-	                                
-	                            }
-	                        }
-	                    } else {
-	                        // not settable, send error
-	                        Snmp_Serial_println(F("[DEBUG SNMP] OID NOT SETTABLE")); 
-	                        SNMPOIDResponse* errorResponse = generateErrorResponse(READ_ONLY, snmprequest->varBindsCursor->value->oid->_value);
-	                        
-	                        	response->addErrorResponse(errorResponse, varBindIndex);
-												}
-	                } else if(snmprequest->requestType == GetRequestPDU || snmprequest->requestType == GetNextRequestPDU){
-	                
-	                    if(callback->type == INTEGER){
-	                        IntegerType* value = new IntegerType();
-	                        if(!((IntegerCallback*)callback)->isFloat){
-	                            value->_value = *(((IntegerCallback*)callback)->value);
-	                        } else {
-	                            value->_value = *(float*)(((IntegerCallback*)callback)->value) * 10;
-	                        }
-	                        OIDResponse->value = value;
-	                    } else if(callback->type == STRING){
-	                        OctetType* value = new OctetType(*((StringCallback*)callback)->value);
-	                        OIDResponse->value = value;
-	                    } else if(callback->type == TIMESTAMP){
-	                        TimestampType* value = new TimestampType(*(((TimestampCallback*)callback)->value));
-	                        OIDResponse->value = value;
-	                    } else if(callback->type == OID){
-	                        OIDType* value = new OIDType((((OIDCallback*)callback)->value));
-	                        OIDResponse->value = value;
-	                    } else if(callback->type == COUNTER64){
-	                        Counter64* value = new Counter64(*((Counter64Callback*)callback)->value);
-	                        OIDResponse->value = value;
-	                    } else if(callback->type == COUNTER32){
-	                        Counter32* value = new Counter32(*((Counter32Callback*)callback)->value);
-	                        OIDResponse->value = value;
-	                    } else if(callback->type == GUAGE32){
-	                        Guage* value = new Guage(*((Guage32Callback*)callback)->value);
-	                        OIDResponse->value = value;
-	                    }
-	                    
-	                    ///////////////
+	                if(snmprequest.requestType == GetRequestPDU || snmprequest.requestType == GetNextRequestPDU){
+	                    SNMPOIDResponse* OIDResponse = new SNMPOIDResponse();
+	                    OIDResponse->errorStatus = NO_ERROR;
+	                    OIDResponse->oid = new OIDType(callback->oidSubids, callback->oidLength);
+	                    OIDResponse->type = callback->type;
+	                    OIDResponse->value = readValue(callback);
 	                    response->addResponse(OIDResponse);
 	                }
 	            } else {
 	                // inject a NoSuchObject error
 	                Snmp_Serial_println(F("[DEBUG SNMP] OID NOT FOUND")); 
-	                SNMPOIDResponse* errorResponse = generateErrorResponse(NO_SUCH_NAME, snmprequest->varBindsCursor->value->oid->_value);
+	                SNMPOIDResponse* errorResponse = generateErrorResponse(NO_SUCH_NAME, requestOID, requestOIDLength);
 	                
 	                 	response->addErrorResponse(errorResponse, varBindIndex);
 	            }
 	            
 	            // -------------------------
-	            snmprequest->varBindsCursor = snmprequest->varBindsCursor->next;
-	            if(!snmprequest->varBindsCursor->value){
-	                break;
-	            }
 	            varBindIndex++;
 	        }
+	        if(cacheable && response->errorStatus == NO_ERROR){
+	            _templates.store(&snmprequest, resolved);
+	        }
 	//        Snmp_Serial_println(F("[DEBUG SNMP] Sending UDP"));
-	        memset(_packetBuffer, 0, SNMP_PACKET_LENGTH*3);
-	        int length = response->serialise(_packetBuffer);
-	        if(length <= SNMP_PACKET_LENGTH*2){
+	        BERWriter writer(_txBuffer, responseLimit(response));
+	        int length;
+	        if(cached){
+	            length = response->serialise(writer, serialiseTemplate(cached, &snmprequest, writer));
+	        } else {
+	            length = response->serialise(writer);
+	        }
+	        if(!length){
+	            // too long for the buffer, answer with tooBig and no varbinds instead
+	            Snmp_Serial_println(F("[DEBUG SNMP] Response too big"));
+	            response->setTooBig();
+	            writer = BERWriter(_txBuffer, responseLimit(response));
+	            length = response->serialise(writer);
+	        }
+	        if(length){
 	        	Snmp_Serial_print(F("[DEBUG SNMP] Send packet to IP: "));		Snmp_Serial_print(_udp->remoteIP());
 	        	Snmp_Serial_print(F("  Port: "));		Snmp_Serial_println(_udp->remotePort());
 	        	
 	            _udp->beginPacket(_udp->remoteIP(), _udp->remotePort());
-	            _udp->write(_packetBuffer, length);
-	            if(!_udp->endPacket()){
+	            _udp->write(writer.data(), length);
+	            if(_udp->endPacket()){
+	                stats.outPkts++;
+	                stats.outGetResponses++;
+	                switch(response->errorStatus){
+	                    case TOO_BIG:      stats.outTooBigs++;     break;
+	                    case NO_SUCH_NAME: stats.outNoSuchNames++; break;
+	                    case BAD_VALUE:    stats.outBadValues++;   break;
+	                    case GEN_ERR:      stats.outGenErrs++;     break;
+	                    default: break;
+	                }
+	            } else {
+	                stats.sendFailures++;
 	                Snmp_Serial_println(F("[DEBUG SNMP] COULDN'T SEND PACKET"));
 	                for(int i = 0;  i < length; i++){
-	                    Snmp_Serial_print(_packetBuffer[i], HEX);
+	                    Snmp_Serial_print(writer.data()[i], HEX);
 	                }
 	                Snmp_Serial_println();
 	                Snmp_Serial_print(F("[DEBUG SNMP] Length: "));		Snmp_Serial_println(length);
@@ -466,70 +1364,411 @@
 	            }
 	        } else {
 	            Snmp_Serial_println(F("[DEBUG SNMP] dropping packet"));
+	            stats.silentDrops++;
 	        }
 	        
-	        delete response;
+	        // only what didn't fit in the arena came off the heap and has to be freed one by one
+	        if(_arena.spills){
+	            delete response;
+	        }
 	    } else {
 	        Snmp_Serial_println(F("[DEBUG SNMP] CORRUPT PACKET"));
-	        VarBindList* tempList = snmprequest->varBinds;
-	        if(tempList){
-	            while(tempList->next){
-	                delete tempList->value->oid;
-	                delete tempList->value->value;
-	                tempList = tempList->next;
-	            }
-	            delete tempList->value->oid;
-	            delete tempList->value->value;
-	        }
+	        stats.inASNParseErrs++;
 	    }
-	    delete snmprequest;
 	
 			//Snmp_Serial_printf("[DEBUG SNMP] Current heap size: %u\n", ESP.getFreeHeap());
 	    return true;
 	}
 	
-	ValueCallback* SNMPAgent::findCallback(char* oid, bool next)
+	#if SNMP_V3
+	bool SNMPAgent::sendReport(SNMPv3Message* message)
+	{
+	    // RFC 3414: the usmStats counter that went up tells the manager what was wrong, and the message
+	    // around it carries the engineID, engineBoots and engineTime it needs to put it right
+	    uint32_t oid[] = {1, 3, 6, 1, 6, 3, 15, 1, 1, message->report, 0};
+	    SNMPResponse* response = new SNMPResponse();
+	    response->responseType = ReportPDU;
+	    response->requestID = message->requestID;
+	    response->v3 = message;
+	    SNMPOIDResponse* report = new SNMPOIDResponse();
+	    report->errorStatus = NO_ERROR;
+	    report->oid = new OIDType(oid, 11);
+	    report->type = COUNTER32;
+	    report->value = new Counter32(message->reportCount);
+	    response->addResponse(report);
+	    
+	    BERWriter writer(_txBuffer, responseLimit(response));
+	    int length = response->serialise(writer);
+	    if(length){
+	        _udp->beginPacket(_udp->remoteIP(), _udp->remotePort());
+	        _udp->write(writer.data(), length);
+	        if(_udp->endPacket()){
+	            stats.outPkts++;
+	        } else {
+	            stats.sendFailures++;
+	        }
+	    }
+	    if(_arena.spills){
+	        delete response;
+	    }
+	    return true;
+	}
+	
+	bool SNMPAgent::addUser(const char* name, const char* authPassword, const char* privPassword, bool readWrite)
 	{
-	    bool useNext = false;
-	    callbacksCursor = callbacks;
+	    SNMPMutexGuard guard(_lock);
+	    return _v3.addUser(name, authPassword, privPassword, readWrite);
+	}
+	
+	bool SNMPAgent::addUserWithKeys(const char* name, const unsigned char* authKey, const unsigned char* privKey, bool readWrite)
+	{
+	    SNMPMutexGuard guard(_lock);
+	    return _v3.addUserWithKeys(name, authKey, privKey, readWrite);
+	}
+	
+	void SNMPAgent::setEngineID(const unsigned char* id, int length)
+	{
+	    SNMPMutexGuard guard(_lock);
+	    _v3.setEngineID(id, length);
+	}
+	
+	void SNMPAgent::setEngineBoots(uint32_t boots)
+	{
+	    SNMPMutexGuard guard(_lock);
+	    _v3.boots = boots;
+	}
+	#endif
+	
+	int SNMPAgent::serialiseTemplate(SNMPResponseTemplate* entry, SNMPRequest* request, BERWriter& writer)
+	{
+	    // the request matched the template byte for byte, so its OIDs are the ones the response needs
+	    VarBind varbinds[SNMP_TEMPLATE_VARBINDS];
+	    int count = 0;
+	    request->resetVarBinds();
+	    while(count < entry->varBindCount && request->nextVarBind(varbinds[count])){
+	        count++;
+	    }
 	    
-	    if(callbacksCursor->value){
-	        while(true){
-	            if(!useNext){
-	                memset(OIDBuf, 0, MAX_OID_LENGTH);
-	                if(!callbacksCursor->value->overwritePrefix){
-	                    strcat(OIDBuf, oidPrefix);
+	    // back to front, like the rest of the response
+	    int length = 0;
+	    for(int i = count - 1; i >= 0; i--){
+	        BER_CONTAINER* value = readValue(entry->handlers[i]);
+	        int varBindLength = value->serialise(writer);
+	        delete value;
+	        writer.putBytes(varbinds[i].oid.value, varbinds[i].oid.length);
+	        varBindLength += varbinds[i].oid.length + writer.putHeader(OID, varbinds[i].oid.length);
+	        length += varBindLength + writer.putHeader(STRUCTURE, varBindLength);
+	    }
+	    return length;
+	}
+	
+	BER_CONTAINER* SNMPAgent::readValue(ValueCallback* callback)
+	{
+	    callback->refresh();
+	    switch(callback->type){
+	        case INTEGER:
+	            if(((IntegerCallback*)callback)->isFloat){
+	                return new IntegerType(*(float*)(((IntegerCallback*)callback)->value) * 10);
+	            }
+	            return new IntegerType(*(((IntegerCallback*)callback)->value));
+	        case STRING:
+	            {
+	                StringCallback* stringCallback = (StringCallback*)callback;
+	                OctetType* string = stringCallback->length < 0 ? new OctetType(*stringCallback->value) : new OctetType((unsigned char*)*stringCallback->value, stringCallback->length);
+	                if(stringCallback->transient){
+	                    string->copy();
 	                }
-	                strcat(OIDBuf, callbacksCursor->value->OID);
-	                if(strcmp(OIDBuf, oid) == 0){
-	                    //  found
-	                    if(next){
-	                        useNext = true;
-	                    } else {
-	                        return callbacksCursor->value;
-	                    }
-	                } else if(next){
-	                    // doesn't match, lets do a strstr to find out if it's possible for a walk
-	                    if(strstr(OIDBuf, oid)){ // this is the first occurance of the ENTIRE requested OID, which means it's the start of a walk, lets start here
-	                        return callbacksCursor->value;
-	                    }
+	                return string;
+	            }
+	        case TIMESTAMP:
+	            return new TimestampType(*(((TimestampCallback*)callback)->value));
+	        case OID:
+	            {
+	                // parsed when it was registered, only a static MIB's cell is still a string
+	                OIDCallback* oid = (OIDCallback*)callback;
+	                return oid->subids ? new OIDType(oid->subids, oid->subidsLength) : new OIDType(oid->value);
+	            }
+	        case COUNTER64:
+	            return new Counter64(*((Counter64Callback*)callback)->value);
+	        case COUNTER32:
+	            return new Counter32(*((Counter32Callback*)callback)->value);
+	        case GUAGE32:
+	            return new Guage(*((Guage32Callback*)callback)->value);
+	        default:
+	            return new NullType();
+	    }
+	}
+	
+	int SNMPAgent::responseLimit(SNMPResponse* response)
+	{
+	#if SNMP_V3
+	    // a v3 manager says how long a reply it can take, v1 and v2c ones get whatever fits the buffer
+	    if(response->v3){
+	        return MIN(response->v3->maxSize, SNMP_TX_BUFFER_LENGTH);
+	    }
+	#endif
+	    return SNMP_TX_BUFFER_LENGTH;
+	}
+
+	bool SNMPAgent::handleBulkRequest(SNMPRequest* request, SNMPResponse* response)
+	{
+	    if(request->version < 2){
+	        Snmp_Serial_println(F("[DEBUG SNMP] GetBulk is not part of SNMPv1, dropping packet"));
+	        return false;
+	    }
+	    
+	    int nonRepeaters = MIN(MAX(request->nonRepeaters(), 0), request->varBindCount);
+	    int repeaters = request->varBindCount - nonRepeaters;
+	    int maxRepetitions = MAX(request->maxRepetitions(), 0);
+	    int limit = responseLimit(response);
+	    if(repeaters){
+	        // every varbind takes more than a byte, so no more rows than that can fit, and the total can't overflow
+	        maxRepetitions = MIN(maxRepetitions, limit / repeaters);
+	    }
+	    
+	    // whatever doesn't fit in one packet is left off the end, the manager carries on from the last OID it got.
+	    // the 6 bytes leave room for the message, PDU and varbind list lengths to grow into long form
+	    BERWriter counter;
+	    int used = response->serialise(counter) + 6;
+	    
+	    VarBind varbind;
+	    uint32_t requestOID[MAX_OID_SUBIDENTIFIERS];
+	    ResponseList* previous = 0;
+	    int total = nonRepeaters + repeaters * maxRepetitions;
+	    for(int i = 0; i < total; i++){
+	        const uint32_t* oid;
+	        int oidLength;
+	        if(i < request->varBindCount){
+	            request->nextVarBind(varbind);
+	            oidLength = BERReader::readOID(varbind.oid, requestOID, MAX_OID_SUBIDENTIFIERS);
+	            if(oidLength < 0){
+	                Snmp_Serial_println(F("[DEBUG SNMP] OID too long or malformed, dropping packet"));
+	                return false;
+	            }
+	            oid = requestOID;
+	        } else {
+	            // later repetitions carry on from what the same repeater got last time round, exactly one row back
+	            if(!previous){
+	                previous = response->responseList;
+	                for(int skip = 0; skip < nonRepeaters; skip++){
+	                    previous = previous->next;
 	                }
-	            } else {
-	                return callbacksCursor->value;
 	            }
-	            
-	            if(callbacksCursor->next){
-	                callbacksCursor = callbacksCursor->next;
-	            } else {
-	                break;
+	            oid = previous->value->oid->_value;
+	            oidLength = previous->value->oid->_valueLength;
+	            previous = previous->next;
+	        }
+	        
+	        SNMPOIDResponse* OIDResponse = new SNMPOIDResponse();
+	        OIDResponse->errorStatus = NO_ERROR;
+	        ValueCallback* callback = findCallback(oid, oidLength, true);
+	        if(callback){
+	            OIDResponse->oid = new OIDType(callback->oidSubids, callback->oidLength);
+	            OIDResponse->type = callback->type;
+	            OIDResponse->value = readValue(callback);
+	        } else {
+	            // past the last handler, v2c reports that per varbind rather than as an error
+	            OIDResponse->oid = new OIDType(oid, oidLength);
+	            OIDResponse->type = ENDOFMIBVIEW;
+	            OIDResponse->value = new NullType();
+	            OIDResponse->value->_type = ENDOFMIBVIEW;
+	        }
+	        
+	        int length = SNMPResponse::serialisedLength(OIDResponse);
+	        if(used + length > limit){
+	            Snmp_Serial_println(F("[DEBUG SNMP] GetBulk response full, truncating"));
+	            delete OIDResponse;
+	            break;
+	        }
+	        used += length;
+	        response->addResponse(OIDResponse);
+	        
+	        // once every repeater in the row just finished has run off the end there's nothing left to find
+	        if(previous && (i - nonRepeaters) % repeaters == repeaters - 1){
+	            bool finished = true;
+	            ResponseList* row = previous;
+	            while(row && row->value){
+	                if(row->value->type != ENDOFMIBVIEW) finished = false;
+	                row = row->next;
+	            }
+	            if(finished) break;
+	        }
+	    }
+	    return true;
+	}
+	
+	bool SNMPAgent::handleSetRequest(SNMPRequest* request, SNMPResponse* response, bool writable)
+	{
+	    // plain data, so zeroed memory is a constructed array of them
+	    static_assert(__is_trivial(SNMPSetOperation), "SNMPSetOperation is allocated as raw memory");
+	    size_t operationsSize = sizeof(SNMPSetOperation) * MAX(request->varBindCount, 1);
+	    SNMPSetOperation* operations = (SNMPSetOperation*)SNMPArenaAllocated::operator new(operationsSize);
+	    ERROR_STATUS error = NO_ERROR;
+	    int errorIndex = 0;
+	    if(operations){
+	        memset(operations, 0, operationsSize);
+	    } else {
+	        Snmp_Serial_println(F("[DEBUG SNMP] NO MEMORY FOR SET"));
+	        error = GEN_ERR;
+	    }
+	    int count = 0;
+	    VarBind varbind;
+	    uint32_t oid[MAX_OID_SUBIDENTIFIERS];
+	    
+	    // test: nothing is written unless every varbind can be
+	    while(request->nextVarBind(varbind)){
+	        int oidLength = BERReader::readOID(varbind.oid, oid, MAX_OID_SUBIDENTIFIERS);
+	        if(oidLength < 0){
+	            Snmp_Serial_println(F("[DEBUG SNMP] OID too long or malformed, dropping packet"));
+	            SNMPArenaAllocated::operator delete(operations);
+	            return false;
+	        }
+	        if(error == NO_ERROR){
+	            error = operations[count++].test(findCallback(oid, oidLength, false), varbind, writable);
+	            errorIndex = count;
+	        }
+	    }
+	    
+	    // commit, and if a handler won't take its value put back what's been written so far, newest first
+	    // so an OID given twice ends up as it was before either
+	    int written = 0;
+	    while(error == NO_ERROR && written < count){
+	        operations[written].apply();
+	        written++;
+	        if(!operations[written - 1].commit()){
+	            Snmp_Serial_println(F("[DEBUG SNMP] COMMIT FAILED"));
+	            error = COMMIT_FAILED;
+	            errorIndex = written;
+	        }
+	    }
+	    if(error == COMMIT_FAILED){
+	        for(int i = written - 1; i >= 0; i--){
+	            operations[i].undo();
+	            // the hooks that took the new value are told about the old one again
+	            if(i < written - 1 && !operations[i].commit()){
+	                error = UNDO_FAILED;
+	                errorIndex = 0;
+	            }
+	        }
+	    } else if(error == NO_ERROR){
+	        errorIndex = 0;
+	        setOccurred = setOccurred || count;
+	    }
+	    for(int i = 0; i < written; i++){
+	        operations[i].release();
+	    }
+	    SNMPArenaAllocated::operator delete(operations);
+	    
+	    // the response carries the varbinds just as they came, whether or not they were set
+	    request->resetVarBinds();
+	    while(request->nextVarBind(varbind)){
+	        SNMPOIDResponse* echoed = new SNMPOIDResponse();
+	        echoed->errorStatus = NO_ERROR;
+	        echoed->oid = new OIDType(oid, BERReader::readOID(varbind.oid, oid, MAX_OID_SUBIDENTIFIERS));
+	        OctetType* value = new OctetType(varbind.value.value, varbind.value.length);
+	        value->_type = varbind.type();
+	        echoed->value = value;
+	        echoed->type = varbind.type();
+	        response->addResponse(echoed);
+	    }
+	    response->errorStatus = request->version == 1 ? snmp_v1_error(error) : error;
+	    response->errorIndex = errorIndex;
+	    return true;
+	}
+	
+	ValueCallback* SNMPAgent::findCallback(char* oid, bool next)
+	{
+	    uint32_t subids[MAX_OID_SUBIDENTIFIERS];
+	    int length = oid_parse(oid, subids, MAX_OID_SUBIDENTIFIERS);
+	    if(length < 0) return 0;
+	    return findCallback(subids, length, next);
+	}
+	
+	ValueCallback* SNMPAgent::findCallback(const uint32_t* oid, int oidLength, bool next)
+	{
+	    ValueCallback* callback = findHandler(oid, oidLength, next);
+	    if(!_staticMIB.count){
+	        return callback;
+	    }
+	    if(!next){
+	        return callback ? callback : _staticMIB.find(oid, oidLength, false);
+	    }
+	    // for a getnext, whichever of the two comes first. The entries are compared by OID, so a static
+	    // getter only runs for the one that's answered with
+	    int fixed = _staticMIB.locate(oid, oidLength, true);
+	    if(fixed < 0 || (callback && _staticMIB.compare(fixed, callback->oidSubids, callback->oidLength) >= 0)){
+	        return callback;
+	    }
+	    return _staticMIB.cell(fixed);
+	}
+	
+	void SNMPAgent::setStaticMIB(const SNMPStaticEntry* entries, uint16_t count)
+	{
+	    SNMPMutexGuard guard(_lock);
+	    _templates.clear();
+	    _staticMIB.entries = entries;
+	    _staticMIB.count = count;
+	}
+	
+	ValueCallback* SNMPAgent::findHandler(const uint32_t* oid, int oidLength, bool next)
+	{
+	    // a get wants the handler at oid, a getnext the first one after it in lexicographic order
+	    int index = findHandlerIndex(oid, oidLength, next);
+	    
+	    // a table sorts in front of all of its cells and nothing else is let into its subtree, so a cell's table
+	    // is the handler just before it
+	    if(index > 0 && handlers[index - 1]->isTable){
+	        TableCallback* table = (TableCallback*)handlers[index - 1];
+	        if(oid_starts_with(oid, oidLength, table->oidSubids, table->oidLength)){
+	            ValueCallback* cell = table->findCell(oid, oidLength, next);
+	            if(cell || !next){
+	                return cell;
 	            }
 	        }
 	    }
 	    
+	    for(; index < handlerCount; index++){
+	        ValueCallback* callback = handlers[index];
+	        if(!next){
+	            // a table itself isn't something that can be got
+	            if(callback->isTable || oid_compare(callback->oidSubids, callback->oidLength, oid, oidLength) != 0){
+	                return 0;
+	            }
+	            return callback;
+	        }
+	        if(!callback->isTable){
+	            return callback;
+	        }
+	        // oid is in front of this table, so that's its first cell. Tables without rows are stepped over
+	        ValueCallback* cell = ((TableCallback*)callback)->findCell(oid, oidLength, true);
+	        if(cell){
+	            return cell;
+	        }
+	    }
 	    return 0;
 	}
 	
-	ValueCallback* SNMPAgent::addStringHandler(char* oid, char** value, bool isSettable, bool overwritePrefix)
+	int SNMPAgent::findHandlerIndex(const uint32_t* oid, int oidLength, bool after)
+	{
+	    // index of the first handler at or after oid (strictly after if after is set), handlerCount if there isn't one
+	    if(!_handlersSorted){
+	        sortHandlers();
+	    }
+	    int low = 0;
+	    int high = handlerCount;
+	    while(low < high){
+	        int mid = (low + high) / 2;
+	        int comparison = oid_compare(handlers[mid]->oidSubids, handlers[mid]->oidLength, oid, oidLength);
+	        if(comparison < 0 || (after && comparison == 0)){
+	            low = mid + 1;
+	        } else {
+	            high = mid;
+	        }
+	    }
+	    return low;
+	}
+	
+	ValueCallback* SNMPAgent::addStringHandler(char* oid, char** value, bool isSettable, bool overwritePrefix, unsigned short size)
 	{
 	    ValueCallback* callback = new StringCallback();
 	    callback->overwritePrefix = overwritePrefix;
@@ -537,8 +1776,8 @@
 	    callback->OID = (char*)malloc((sizeof(char) * strlen(oid)) + 1);
 	    strcpy(callback->OID, oid);
 	    ((StringCallback*)callback)->value = value;
-	    addHandler(callback);
-	    return callback;
+	    ((StringCallback*)callback)->size = size;
+	    return addOwnedHandler(callback);
 	}
 	
 	ValueCallback* SNMPAgent::addIntegerHandler(char* oid, int* value, bool isSettable, bool overwritePrefix)
@@ -550,8 +1789,7 @@
 	    strcpy(callback->OID, oid);
 	    ((IntegerCallback*)callback)->value = value;
 	    ((IntegerCallback*)callback)->isFloat = false;
-	    addHandler(callback);
-	    return callback;
+	    return addOwnedHandler(callback);
 	}
 	
 	ValueCallback* SNMPAgent::addFloatHandler(char* oid, float* value, bool isSettable, bool overwritePrefix)
@@ -563,8 +1801,7 @@
 	    strcpy(callback->OID, oid);
 	    ((IntegerCallback*)callback)->value = (int*)value;
 	    ((IntegerCallback*)callback)->isFloat = true;
-	    addHandler(callback);
-	    return callback;
+	    return addOwnedHandler(callback);
 	}
 	
 	ValueCallback* SNMPAgent::addTimestampHandler(char* oid, int* value, bool isSettable, bool overwritePrefix)
@@ -575,8 +1812,7 @@
 	    callback->OID = (char*)malloc((sizeof(char) * strlen(oid)) + 1);
 	    strcpy(callback->OID, oid);
 	    ((TimestampCallback*)callback)->value = value;
-	    addHandler(callback);
-	    return callback;
+	    return addOwnedHandler(callback);
 	}
 	
 	ValueCallback* SNMPAgent::addOIDHandler(char* oid, char* value, bool overwritePrefix)
@@ -585,9 +1821,8 @@
 	    callback->overwritePrefix = overwritePrefix;
 	    callback->OID = (char*)malloc((sizeof(char) * strlen(oid)) + 1);
 	    strcpy(callback->OID, oid);
-	    ((OIDCallback*)callback)->value = value;
-	    addHandler(callback);
-	    return callback;
+	    ((OIDCallback*)callback)->setValue(value);
+	    return addOwnedHandler(callback);
 	}
 	
 	ValueCallback* SNMPAgent::addCounter64Handler(char* oid, uint64_t* value, bool overwritePrefix)
@@ -597,8 +1832,7 @@
 	    callback->OID = (char*)malloc((sizeof(char) * strlen(oid)) + 1);
 	    strcpy(callback->OID, oid);
 	    ((Counter64Callback*)callback)->value = value;
-	    addHandler(callback);
-	    return callback;
+	    return addOwnedHandler(callback);
 	}
 	
 	ValueCallback* SNMPAgent::addCounter32Handler(char* oid, uint32_t* value, bool overwritePrefix)
@@ -608,8 +1842,7 @@
 	    callback->OID = (char*)malloc((sizeof(char) * strlen(oid)) + 1);
 	    strcpy(callback->OID, oid);
 	    ((Counter32Callback*)callback)->value = value;
-	    addHandler(callback);
-	    return callback;
+	    return addOwnedHandler(callback);
 	}
 	
 	ValueCallback* SNMPAgent::addGuageHandler(char* oid, uint32_t* value, bool overwritePrefix)
@@ -619,171 +1852,359 @@
 	    callback->OID = (char*)malloc((sizeof(char) * strlen(oid)) + 1);
 	    strcpy(callback->OID, oid);
 	    ((Guage32Callback*)callback)->value = value;
-	    addHandler(callback);
-	    return callback;
+	    return addOwnedHandler(callback);
 	}
 	
-	void SNMPAgent::addHandler(ValueCallback* callback)
+	ValueCallback* SNMPAgent::addHandler(char* oid, ValueCallback* callback, bool overwritePrefix)
 	{
-	    callbacksCursor = callbacks;
-	    if(callbacksCursor->value){
-	        while(callbacksCursor->next != 0){
-	            callbacksCursor = callbacksCursor->next;
-	        }
-	        callbacksCursor->next = new ValueCallbacks();
-	        callbacksCursor = callbacksCursor->next;
-	        callbacksCursor->value = callback;
-	        callbacksCursor->next = 0;
-	    } else 
-	        callbacks->value = callback;
+	    callback->overwritePrefix = overwritePrefix;
+	    callback->OID = (char*)malloc((sizeof(char) * strlen(oid)) + 1);
+	    strcpy(callback->OID, oid);
+	    return addOwnedHandler(callback);
 	}
 	
-	// Let's implement this properly, we also want to inntroduce a sort() so after we add or remove stuff around we can make sure snmpwalk will still erturn in an expected way.
+	TableCallback* SNMPAgent::addTableHandler(char* oid, uint32_t (*rowCount)(), bool overwritePrefix)
+	{
+	    return (TableCallback*)addHandler(oid, new TableCallback(rowCount), overwritePrefix);
+	}
 	
-	bool SNMPAgent::removeHandler(ValueCallback* callback)			// this will remove the callback from the list and shift everything in the list back so there are no gaps, this will not delete the actual callback
+	TableCallback* SNMPAgent::addTableHandler(char* oid, uint32_t (*nextRow)(uint32_t after), bool overwritePrefix)
 	{
-	    callbacksCursor = callbacks;
-	    // Snmp_Serial_println(F("[DEBUG SNMP] Entering hell..."));
-	    if(!callbacksCursor->value){
-	            return false;
+	    return (TableCallback*)addHandler(oid, new TableCallback(nextRow), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addIntegerHandler(char* oid, int (*getter)(), unsigned long ttl, bool overwritePrefix)
+	{
+	    return addHandler(oid, new IntegerFunctionCallback(getter, ttl), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addTimestampHandler(char* oid, int (*getter)(), unsigned long ttl, bool overwritePrefix)
+	{
+	    return addHandler(oid, new TimestampFunctionCallback(getter, ttl), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addStringHandler(char* oid, const char* (*getter)(), unsigned long ttl, bool overwritePrefix)
+	{
+	    return addHandler(oid, new StringFunctionCallback(getter, ttl), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addCounter32Handler(char* oid, uint32_t (*getter)(), unsigned long ttl, bool overwritePrefix)
+	{
+	    return addHandler(oid, new Counter32FunctionCallback(getter, ttl), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addGuageHandler(char* oid, uint32_t (*getter)(), unsigned long ttl, bool overwritePrefix)
+	{
+	    return addHandler(oid, new Guage32FunctionCallback(getter, ttl), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addCounter64Handler(char* oid, uint64_t (*getter)(), unsigned long ttl, bool overwritePrefix)
+	{
+	    return addHandler(oid, new Counter64FunctionCallback(getter, ttl), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addIntegerHandler(char* oid, SNMPPublished<int>* value, bool overwritePrefix)
+	{
+	    return addHandler(oid, new IntegerPublishedCallback(value), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addTimestampHandler(char* oid, SNMPPublished<int>* value, bool overwritePrefix)
+	{
+	    return addHandler(oid, new TimestampPublishedCallback(value), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addCounter32Handler(char* oid, SNMPPublished<uint32_t>* value, bool overwritePrefix)
+	{
+	    return addHandler(oid, new Counter32PublishedCallback(value), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addGuageHandler(char* oid, SNMPPublished<uint32_t>* value, bool overwritePrefix)
+	{
+	    return addHandler(oid, new Guage32PublishedCallback(value), overwritePrefix);
+	}
+	
+	ValueCallback* SNMPAgent::addCounter64Handler(char* oid, SNMPPublished<uint64_t>* value, bool overwritePrefix)
+	{
+	    return addHandler(oid, new Counter64PublishedCallback(value), overwritePrefix);
+	}
+	
+	bool SNMPAgent::resolveOID(ValueCallback* callback)
+	{
+	    uint32_t subids[MAX_OID_SUBIDENTIFIERS];
+	    int length = 0;
+	    if(!callback->overwritePrefix){
+	        memcpy(subids, _oidPrefix, _oidPrefixLength * sizeof(uint32_t));
+	        length = _oidPrefixLength;
 	    }
-	    bool shifting = false;
-	    if(callbacksCursor->value == callback){ // first callback is it
-	        shifting = true;
-	        callbacks = callbacksCursor->next; // save next element to the current global cursor
-	    } else {
-	        while(callbacksCursor->next != 0){
-	            if(callbacksCursor->next->value == callback){ // if the thing pouinted to by NEXT is the thing we want to remove
-	                if(callbacksCursor->next->next != 0){ // if next has a next that we replace the first next by
-	                    callbacksCursor->next = callbacksCursor->next->next;
-	                } else {
-	                    callbacksCursor->next = 0;
-	                }
-	                shifting = true;
-	                break;
-	            }
-	            callbacksCursor = callbacksCursor->next;
-	        }
+	    int oidLength = oid_parse(callback->OID, subids + length, MAX_OID_SUBIDENTIFIERS - length);
+	    if(oidLength < 0){
+	        oidLength = 0;
 	    }
+	    length += oidLength;
 	    
-	    return shifting;
+	    free(callback->oidSubids);
+	    callback->oidSubids = (uint32_t*)malloc(sizeof(uint32_t) * (length ? length : 1));
+	    if(!callback->oidSubids){
+	        callback->oidLength = 0;
+	        return false;
+	    }
+	    memcpy(callback->oidSubids, subids, sizeof(uint32_t) * length);
+	    callback->oidLength = length;
+	    return oidLength > 0;
 	}
 	
-	bool SNMPAgent::sortHandlers() 		// we want to sort our callbacks in order of OID's so we can walk correctly
+	bool SNMPAgent::addHandler(ValueCallback* callback)
 	{
-	    callbacksCursor = callbacks;
+	    SNMPMutexGuard guard(_lock);
+	    _templates.clear();
+	    resolveOID(callback);
+	    if(!callback->oidSubids || (handlerCount == _handlerCapacity && !reserveHandlers(_handlerCapacity ? _handlerCapacity * 2 : 8))){
+	        Snmp_Serial_println(F("[DEBUG SNMP] Out of memory adding handler"));
+	        releaseOID(callback);
+	        return false;
+	    }
 	    
-	    int swapped, i;
-	    ValueCallbacks* ptr1;
-	    ValueCallbacks* lptr = 0;
-	 
-	    /* Checking for empty list */
-	    if (callbacksCursor == 0)       return false;
-	 		
-	    do
-	    {
-	        swapped = 0;
-	        ptr1 = callbacksCursor;
-	 
-	        while (ptr1->next != lptr)
-	        {
-	            char OID1[MAX_OID_LENGTH] = {0};
-	            char OID2[MAX_OID_LENGTH] = {0};
+	    if(_bulkRegistration){
+	        handlers[handlerCount++] = callback;
+	        _handlersSorted = false;
+	        return true;
+	    }
+	    
+	    // binary search for the slot, after any handler with the same OID, and open it up
+	    int index = findHandlerIndex(callback->oidSubids, callback->oidLength, true);
+	    // a table's cells are found through the table sorted just before them, so nothing else can go
+	    // inside its subtree. Nor can a table go over handlers already there
+	    if((index > 0 && insideTable(handlers[index - 1], callback)) || (index < handlerCount && insideTable(callback, handlers[index]))){
+	        Snmp_Serial_println(F("[DEBUG SNMP] Handler inside a table, not added"));
+	        releaseOID(callback);
+	        return false;
+	    }
+	    memmove(&handlers[index + 1], &handlers[index], sizeof(ValueCallback*) * (handlerCount - index));
+	    handlers[index] = callback;
+	    handlerCount++;
+	    return true;
+	}
 	
-	            if(!ptr1->value->overwritePrefix){
-	                strcat(OID1, oidPrefix);
-	            }
-	            strcat(OID1, ptr1->value->OID);
+	ValueCallback* SNMPAgent::addOwnedHandler(ValueCallback* callback)
+	{
+	    // made by one of the add*Handler functions, so it's freed here if it can't be added
+	    if(addHandler(callback)){
+	        return callback;
+	    }
+	    free(callback->OID);
+	    delete callback;
+	    return 0;
+	}
 	
+	void SNMPAgent::releaseOID(ValueCallback* callback)
+	{
+	    free(callback->oidSubids);
+	    callback->oidSubids = 0;
+	    callback->oidLength = 0;
+	}
 	
-	            if(!ptr1->next->value->overwritePrefix){
-	                strcat(OID2, oidPrefix);
-	            }
-	            strcat(OID2, ptr1->next->value->OID);
+	bool SNMPAgent::reserveHandlers(int capacity)
+	{
+	    if(capacity <= _handlerCapacity){
+	        return true;
+	    }
+	    ValueCallback** grown = (ValueCallback**)realloc(handlers, sizeof(ValueCallback*) * capacity);
+	    if(!grown){
+	        return false;
+	    }
+	    handlers = grown;
+	    _handlerCapacity = capacity;
+	    return true;
+	}
 	
+	bool SNMPAgent::enableRFC1213(const char* sysDescr, const char* sysObjectID, SNMPInterfaceProvider* interfaces)
+	{
+	    if(_uptime){
+	        return false; // already enabled
+	    }
+	    systemGroup.descr = sysDescr;
+	    systemGroup.objectID = (char*)sysObjectID;
+	    _systemStrings[0] = systemGroup.contact;
+	    _systemStrings[1] = systemGroup.name;
+	    _systemStrings[2] = systemGroup.location;
+	    char* settable[] = {RFC1213_OID_sysContact, RFC1213_OID_sysName, RFC1213_OID_sysLocation};
+	    
+	    beginBulkRegistration(interfaces ? 9 : 7);
+	    addStringHandler(RFC1213_OID_sysDescr, (char**)&systemGroup.descr, false, true);
+	    addOIDHandler(RFC1213_OID_sysObjectID, systemGroup.objectID, true);
+	    _uptime = (UptimeCallback*)addHandler(RFC1213_OID_sysUpTime, new UptimeCallback(), true);
+	    for(int i = 0; i < 3; i++){
+	        StringCallback* string = (StringCallback*)addStringHandler(settable[i], &_systemStrings[i], true, true);
+	        if(string){
+	            string->size = SNMP_SYSTEM_STRING_LENGTH;
+	        }
+	    }
+	    addIntegerHandler(RFC1213_OID_sysServices, &systemGroup.services, false, true);
+	    
+	    if(interfaces){
+	        // the interfaces group reads this agent's provider, not some other agent's
+	        SNMPInterfaces* table = (SNMPInterfaces*)addHandler(RFC1213_OID_ifEntry, new SNMPInterfaces(interfaces, &_request), true);
+	        if(table){
+	            addHandler(RFC1213_OID_ifNumber, new SNMPInterfaceCount(table), true);
+	        }
+	    }
+	    return endBulkRegistration();
+	}
 	
-	            if (!sort_oid(OID1, OID2))
-	            { 
-	                swap(ptr1, ptr1->next);
-	                swapped = 1;
+	void SNMPAgent::setSystemStrings(const char* contact, const char* name, const char* location)
+	{
+	    SNMPMutexGuard guard(_lock);
+	    const char* strings[] = {contact, name, location};
+	    char* buffers[] = {systemGroup.contact, systemGroup.name, systemGroup.location};
+	    for(int i = 0; i < 3; i++){
+	        if(strings[i]){
+	            strncpy(buffers[i], strings[i], SNMP_SYSTEM_STRING_LENGTH - 1);
+	            buffers[i][SNMP_SYSTEM_STRING_LENGTH - 1] = 0;
+	        }
+	    }
+	}
+	
+	bool SNMPAgent::enableStats(const char* subtree)
+	{
+	    struct StatsOID {
+	        uint8_t id;
+	        uint32_t* value;
+	    };
+	    // SNMPv2-MIB snmp group, the gaps are the counters this agent has no use for
+	    StatsOID standard[] = {
+	        {1, &stats.inPkts}, {2, &stats.outPkts}, {3, &stats.inBadVersions}, {4, &stats.inBadCommunityNames},
+	        {6, &stats.inASNParseErrs}, {15, &stats.inGetRequests}, {16, &stats.inGetNexts}, {17, &stats.inSetRequests},
+	        {18, &stats.inGetResponses}, {20, &stats.outTooBigs}, {21, &stats.outNoSuchNames}, {22, &stats.outBadValues},
+	        {24, &stats.outGenErrs}, {28, &stats.outGetResponses}, {29, &stats.outTraps}, {31, &stats.silentDrops}
+	    };
+	    StatsOID own[] = {
+	        {1, &stats.inGetBulks}, {2, &stats.oversizeDrops}, {3, &stats.sendFailures}, {4, &stats.authFailures},
+	        {5, &stats.requests}, {6, &stats.minMicros}, {7, &stats.averageMicros}, {8, &stats.maxMicros},
+	        {10, &stats.peakRequestBytes}
+	    };
+	    
+	    char oid[MAX_OID_LENGTH];
+	    if(subtree && (int)strlen(subtree) + 6 >= MAX_OID_LENGTH){
+	        return false;
+	    }
+	    beginBulkRegistration(sizeof(standard) / sizeof(standard[0]) + (subtree ? sizeof(own) / sizeof(own[0]) + 1 : 0));
+	    for(unsigned i = 0; i < sizeof(standard) / sizeof(standard[0]); i++){
+	        snprintf(oid, sizeof(oid), ".1.3.6.1.2.1.11.%d.0", standard[i].id);
+	        addCounter32Handler(oid, standard[i].value, true);
+	    }
+	#if SNMP_V3
+	    // usmStats (RFC 3414), numbered the way a Report carries them
+	    uint32_t* usm[] = {&_v3.stats.unsupportedSecLevels, &_v3.stats.notInTimeWindows, &_v3.stats.unknownUserNames,
+	        &_v3.stats.unknownEngineIDs, &_v3.stats.wrongDigests, &_v3.stats.decryptionErrors};
+	    for(unsigned i = 0; i < sizeof(usm) / sizeof(usm[0]); i++){
+	        snprintf(oid, sizeof(oid), ".1.3.6.1.6.3.15.1.1.%d.0", i + 1);
+	        addCounter32Handler(oid, usm[i], true);
+	    }
+	#endif
+	    if(subtree){
+	        for(unsigned i = 0; i < sizeof(own) / sizeof(own[0]); i++){
+	            snprintf(oid, sizeof(oid), "%s.%d.0", subtree, own[i].id);
+	            // the times and the memory go up and down, the rest only count up
+	            if(own[i].id >= 6){
+	                addGuageHandler(oid, own[i].value, true);
+	            } else {
+	                addCounter32Handler(oid, own[i].value, true);
 	            }
-	            ptr1 = ptr1->next;
 	        }
-	        lptr = ptr1;
+	        snprintf(oid, sizeof(oid), "%s.9.0", subtree);
+	        addCounter64Handler(oid, &stats.totalMicros, true);
 	    }
-	    while (swapped);
-	    return true;
+	    return endBulkRegistration();
 	}
 	
-	void SNMPAgent::swap(ValueCallbacks* one, ValueCallbacks* two)
+	void SNMPAgent::beginBulkRegistration(int expectedHandlers)
 	{
-	    ValueCallback* temp = one->value;
-	    one->value = two->value;
-	    two->value = temp; 
+	    SNMPMutexGuard guard(_lock);
+	    reserveHandlers(handlerCount + expectedHandlers);
+	    _bulkRegistration = true;
 	}
 	
-	bool SNMPAgent::sort_oid(char* oid1, char* oid2)		 // returns true if oid1 EARLIER than oid2
+	bool SNMPAgent::endBulkRegistration()
 	{
-	    uint16_t oid_nums_1[MAX_OID_LENGTH] = {0}; // max 40 deep
-	    uint16_t oid_nums_2[MAX_OID_LENGTH] = {0}; // max 40 deep
+	    SNMPMutexGuard guard(_lock);
+	    _bulkRegistration = false;
+	    return sortHandlers();
+	}
 	
-	    int i = 0; // current num_array index
-	    bool toBreak = false;
-	    
-	    while(*oid1){
-	        if(*oid1 == '.') oid1++;
-	        int num = 0;
-	        if(sscanf(oid1, "%d", &num)){
-	            // worked?
-	            oid_nums_1[i++] = num;
-	            while(*oid1 != '.') {
-	                if(*oid1 == 0){
-	                    toBreak = true;
-	                    break;
-	                }
-	                oid1++;
-	            }
-	            if(toBreak) break;
-	        } else {
-	            // break
-	            break;
+	bool SNMPAgent::removeHandler(ValueCallback* callback)			// this will remove the callback from the list and shift everything in the list back so there are no gaps, this will not delete the actual callback
+	{
+	    SNMPMutexGuard guard(_lock);
+	    _templates.clear();
+	    for(int i = 0; i < handlerCount; i++){
+	        if(handlers[i] == callback){
+	            // shifting keeps the remaining handlers in order
+	            memmove(&handlers[i], &handlers[i + 1], sizeof(ValueCallback*) * (handlerCount - i - 1));
+	            handlerCount--;
+	            releaseOID(callback);
+	            return true;
 	        }
 	    }
+	    return false;
+	}
 	
-	    i = 0; // current num_array index
-	    toBreak = false;
-	    
-	    while(*oid2){
-	        if(*oid2 == '.') oid2++;
-	        int num = 0;
-	        if(sscanf(oid2, "%d", &num)){
-	            // worked?
-	            oid_nums_2[i++] = num;
-	            while(*oid2 != '.') {
-	                if(*oid2 == 0){
-	                    toBreak = true;
-	                    break;
+	bool SNMPAgent::sortHandlers() 		// handlers are kept in order as they're added, this is only needed after bulk registration
+	{
+	    SNMPMutexGuard guard(_lock);
+	    _templates.clear();
+	    if(!_handlersSorted && handlerCount > 1){
+	        // a merge sort rather than qsort, it's stable so handlers with the same OID keep the order they
+	        // were added in, as addHandler keeps them
+	        ValueCallback** scratch = (ValueCallback**)malloc(sizeof(ValueCallback*) * handlerCount);
+	        if(!scratch){
+	            return false;
+	        }
+	        for(int width = 1; width < handlerCount; width *= 2){
+	            for(int low = 0; low < handlerCount; low += 2 * width){
+	                int middle = MIN(low + width, handlerCount);
+	                int high = MIN(low + 2 * width, handlerCount);
+	                int left = low, right = middle, out = low;
+	                while(left < middle && right < high){
+	                    // only a strictly smaller OID overtakes one added earlier
+	                    scratch[out++] = compareHandlers(&handlers[right], &handlers[left]) < 0 ? handlers[right++] : handlers[left++];
 	                }
-	                oid2++;
+	                while(left < middle) scratch[out++] = handlers[left++];
+	                while(right < high) scratch[out++] = handlers[right++];
 	            }
-	            if(toBreak) break;
-	        } else {
-	            // break
-	            break;
+	            memcpy(handlers, scratch, sizeof(ValueCallback*) * handlerCount);
 	        }
+	        free(scratch);
 	    }
-			
-	    for(int j = 0; j < i; j++){
-	        if(oid_nums_1[j] != oid_nums_2[j]){ // if they're the same then we're on same levvel
-	            if(oid_nums_1[j] < oid_nums_2[j]){ // if this level is smaller, then we are earlier. this will also work if this oid is a parent of the other oid because by default we'll be 0
-	                return true;
-	            } else {
-	                return false;
-	            }
+	    _handlersSorted = true;
+	    
+	    // what bulk registration let in that addHandler would have turned away
+	    ValueCallback* table = 0;
+	    int kept = 0;
+	    for(int i = 0; i < handlerCount; i++){
+	        if(insideTable(table, handlers[i])){
+	            Snmp_Serial_println(F("[DEBUG SNMP] Handler inside a table, removed"));
+	            releaseOID(handlers[i]);
+	            continue;
+	        }
+	        if(handlers[i]->isTable){
+	            table = handlers[i];
 	        }
+	        handlers[kept++] = handlers[i];
 	    }
-	    
-	    return true;
+	    bool nested = kept < handlerCount;
+	    handlerCount = kept;
+	    return !nested;
+	}
+	
+	int SNMPAgent::compareHandlers(const void* one, const void* two)
+	{
+	    ValueCallback* first = *(ValueCallback**)one;
+	    ValueCallback* second = *(ValueCallback**)two;
+	    return oid_compare(first->oidSubids, first->oidLength, second->oidSubids, second->oidLength);
 	}
 	
-#endif
+	bool SNMPAgent::insideTable(ValueCallback* table, ValueCallback* callback)
+	{
+	    return table && table->isTable && oid_starts_with(callback->oidSubids, callback->oidLength, table->oidSubids, table->oidLength);
+	}
+	
+	#endif
@@ -1,17 +1,19 @@
 #ifndef BER_h
 	#define BER_h
 	
-	#ifndef SNMP_OCTETSTRING_MAX_LENGTH
-	#define SNMP_OCTETSTRING_MAX_LENGTH 1024
-	#endif
-	
 	#ifndef MAX_OID_LENGTH
 	#define MAX_OID_LENGTH 256
 	#endif
 	
+	#ifndef MAX_OID_SUBIDENTIFIERS
+	#define MAX_OID_SUBIDENTIFIERS 64 // RFC 2578 allows 128, but every decoded OID costs 4 bytes of stack per entry
+	#endif
+	
 	#include <Arduino.h>
 	#include <math.h>
 	
+	#include "SNMPArena.h"
+	
 	typedef enum ASN_TYPE_WITH_VALUE
 	{
 	    // Primitives
@@ -39,9 +41,325 @@
 	    SetRequestPDU = 0xA3,
 	    TrapPDU = 0xA4,
 	    GetBulkRequestPDU = 0xA5,
-	    Trapv2PDU = 0xA7
+	    InformRequestPDU = 0xA6,
+	    Trapv2PDU = 0xA7,
+	    ReportPDU = 0xA8
 	} ASN_TYPE;
 	
+	// OIDs are handled as arrays of numeric sub-identifiers. Dotted strings are only parsed or printed
+	// where the application hands them in, never while answering a request.
+	
+	// parses ".1.3.6.1" (leading dot optional), returns the number of sub-identifiers or -1 if it does not fit
+	inline int oid_parse(const char *oid, uint32_t *subids, int maxLength)
+	{
+	    int length = 0;
+	    if (*oid == '.') oid++;
+	    while (*oid)
+	    {
+	        if (length >= maxLength) return -1;
+	        char *end;
+	        subids[length++] = strtoul(oid, &end, 10);
+	        if (end == oid) return -1;
+	        oid = (*end == '.') ? end + 1 : end;
+	    }
+	    return length;
+	}
+	
+	// prints as ".1.3.6.1", returns the string length or -1 if it does not fit
+	inline int oid_format(const uint32_t *subids, int length, char *buf, int bufLength)
+	{
+	    char *ptr = buf;
+	    *ptr = 0;
+	    for (int i = 0; i < length; i++)
+	    {
+	        int written = snprintf(ptr, buf + bufLength - ptr, ".%lu", (unsigned long)subids[i]);
+	        if (written < 0 || written >= buf + bufLength - ptr) return -1;
+	        ptr += written;
+	    }
+	    return ptr - buf;
+	}
+	
+	// lexicographic order, a parent sorts before its children. <0, 0 or >0 like strcmp
+	inline int oid_compare(const uint32_t *oid1, int length1, const uint32_t *oid2, int length2)
+	{
+	    int length = MIN(length1, length2);
+	    for (int i = 0; i < length; i++)
+	    {
+	        if (oid1[i] != oid2[i])
+	        {
+	            return oid1[i] < oid2[i] ? -1 : 1;
+	        }
+	    }
+	    return length1 - length2;
+	}
+	
+	inline bool oid_starts_with(const uint32_t *oid, int length, const uint32_t *prefix, int prefixLength)
+	{
+	    return length >= prefixLength && oid_compare(oid, prefixLength, prefix, prefixLength) == 0;
+	}
+	
+	// Content octets for INTEGER and the unsigned application types, as few as the value fits in.
+	// INTEGER is two's complement; Counter32, Gauge32, TimeTicks and Counter64 are unsigned, so they
+	// need a leading zero byte whenever the top bit of the first byte would otherwise be set.
+	inline int ber_signed_length(int32_t value)
+	{
+	    int length = 1;
+	    while (length < 4 && (value < -(1L << (8 * length - 1)) || value >= (1L << (8 * length - 1))))
+	    {
+	        length++;
+	    }
+	    return length;
+	}
+	
+	inline int ber_unsigned_length(uint64_t value)
+	{
+	    int length = 1;
+	    while (length < 8 && (value >> (8 * length)))
+	    {
+	        length++;
+	    }
+	    if ((value >> (8 * length - 1)) & 1)
+	    {
+	        length++; // room for the leading zero
+	    }
+	    return length;
+	}
+	
+	// Single pass encoder: the packet is written from the end of the buffer towards the front.
+	// Content always goes in before its header, so every length is known by the time it is written
+	// and no byte ever has to be moved. The finished packet starts at data() and is length() long.
+	// A writer made without a buffer only counts, for sizing something before it goes in a packet.
+	
+	class BERWriter {
+		public:
+		    BERWriter() : _start(0), _end(0), _ptr(0), _measuring(true){};
+		    BERWriter(unsigned char *buf, int size) : _start(buf), _end(buf + size), _ptr(buf + size){};
+		    
+		    unsigned char *_start;
+		    unsigned char *_end;
+		    unsigned char *_ptr;
+		    bool overflow = false; // set once anything didn't fit, the output is garbage from then on
+		    bool _measuring = false;
+		    int _measured = 0;
+		    
+		    unsigned char *data()
+		    {
+		        return _ptr;
+		    }
+		    
+		    int length()
+		    {
+		        return _measuring ? _measured : _end - _ptr;
+		    }
+		    
+		    bool putByte(unsigned char value)
+		    {
+		        if (_measuring)
+		        {
+		            _measured++;
+		            return true;
+		        }
+		        if (_ptr <= _start)
+		        {
+		            overflow = true;
+		            return false;
+		        }
+		        *--_ptr = value;
+		        return true;
+		    }
+		    
+		    bool putBytes(const unsigned char *value, int length)
+		    {
+		        if (_measuring)
+		        {
+		            _measured += length;
+		            return true;
+		        }
+		        if (length > _ptr - _start)
+		        {
+		            overflow = true;
+		            return false;
+		        }
+		        _ptr -= length;
+		        memcpy(_ptr, value, length);
+		        return true;
+		    }
+		    
+		    // big-endian, exactly `length` bytes of value
+		    bool putUnsigned(uint64_t value, int length)
+		    {
+		        while (length--)
+		        {
+		            if (!putByte(value & 0xFF)) return false;
+		            value >>= 8;
+		        }
+		        return true;
+		    }
+		    
+		    // one OID sub-identifier in base 128, the last byte is the only one without the high bit
+		    bool putSubidentifier(uint32_t value)
+		    {
+		        bool last = true;
+		        do
+		        {
+		            if (!putByte((value & 0x7F) | (last ? 0 : 0x80))) return false;
+		            value >>= 7;
+		            last = false;
+		        } while (value);
+		        return true;
+		    }
+		    
+		    // writes type and length in front of `length` bytes of content already written, returns the header size
+		    int putHeader(ASN_TYPE type, unsigned int length)
+		    {
+		        int header = 2;
+		        if (length > 127)
+		        {
+		            int numBytes = 0;
+		            while (length >> (8 * numBytes)) numBytes++;
+		            putUnsigned(length, numBytes);
+		            putByte(0x80 | numBytes);
+		            header += numBytes;
+		        }
+		        else
+		        {
+		            putByte(length);
+		        }
+		        putByte(type);
+		        return header;
+		    }
+	};
+	
+	// Streaming decoder: walks an encoded packet in place and hands back views of each TLV,
+	// the value pointer references the original buffer, so nothing is copied or allocated.
+	// Containers are entered by building a new reader over the view of the container.
+	
+	typedef struct BERViewStruct
+	{
+	    ASN_TYPE type = (ASN_TYPE)0;
+	    unsigned short length = 0; // length of the value, excluding type and length bytes
+	    unsigned char *value = 0;  // start of the value inside the packet
+	} BERView;
+	
+	class BERReader {
+		public:
+		    BERReader() : _ptr(0), _end(0){};
+		    BERReader(unsigned char *buf, unsigned short length) : _ptr(buf), _end(buf + length){};
+		    BERReader(const BERView &view) : _ptr(view.value), _end(view.value + view.length){};
+		    
+		    unsigned char *_ptr;
+		    unsigned char *_end;
+		    bool isCorrupt = false;
+		    
+		    bool atEnd()
+		    {
+		        return _ptr >= _end;
+		    }
+		    
+		    // reads the TLV under the cursor into view and moves past it, false at the end or on malformed data
+		    bool next(BERView &view)
+		    {
+		        if (atEnd() || _end - _ptr < 2)
+		        {
+		            if (!atEnd()) isCorrupt = true;
+		            return false;
+		        }
+		        
+		        unsigned char *ptr = _ptr;
+		        view.type = (ASN_TYPE)*ptr++;
+		        unsigned int length = *ptr++;
+		        // length should be treated as: if first byte is 0x8x, the x is how many bytes follow
+		        if (length > 127)
+		        {
+		            int numBytes = length & 0x7F;
+		            if (numBytes == 0 || numBytes > 2 || _end - ptr < numBytes)
+		            {
+		                isCorrupt = true;
+		                return false;
+		            }
+		            length = 0;
+		            while (numBytes--)
+		            {
+		                length = (length << 8) | *ptr++;
+		            }
+		        }
+		        if ((unsigned int)(_end - ptr) < length)
+		        {
+		            isCorrupt = true;
+		            return false;
+		        }
+		        view.length = length;
+		        view.value = ptr;
+		        _ptr = ptr + length;
+		        return true;
+		    }
+		    
+		    // next() that also insists on the type of the TLV
+		    bool expect(ASN_TYPE type, BERView &view)
+		    {
+		        if (!next(view)) return false;
+		        if (view.type != type)
+		        {
+		            isCorrupt = true;
+		            return false;
+		        }
+		        return true;
+		    }
+		    
+		    static bool readInteger(const BERView &view, long &value)
+		    {
+		        if (view.length == 0 || view.length > sizeof(long)) return false;
+		        // sign extend from the first octet
+		        unsigned long temp = (view.value[0] & 0x80) ? ~0UL : 0UL;
+		        for (unsigned short i = 0; i < view.length; i++)
+		        {
+		            temp = (temp << 8) | view.value[i];
+		        }
+		        value = (long)temp;
+		        return true;
+		    }
+		    
+		    static bool readUnsigned(const BERView &view, uint64_t &value)
+		    {
+		        if (view.length == 0 || view.length > 9) return false;
+		        value = 0;
+		        for (unsigned short i = 0; i < view.length; i++)
+		        {
+		            value = (value << 8) | view.value[i];
+		        }
+		        return true;
+		    }
+		    
+		    // decodes the OID in view into sub-identifiers, returns how many or -1 if it does not fit
+		    static int readOID(const BERView &view, uint32_t *subids, int maxLength)
+		    {
+		        if (view.length == 0 || maxLength < 2) return -1;
+		        int length = 0;
+		        uint32_t subid = 0;
+		        for (unsigned short i = 0; i < view.length; i++)
+		        {
+		            // a sub-identifier past 32 bits would come out as some other OID, so it's an error
+		            if (subid > 0x1FFFFFF) return -1;
+		            subid = (subid << 7) | (view.value[i] & 0x7F);
+		            if (view.value[i] & 0x80) continue;
+		            
+		            if (length == 0)
+		            {
+		                // first encoded sub-identifier carries the first two arcs
+		                uint32_t arc = subid < 80 ? subid / 40 : 2;
+		                subids[length++] = arc;
+		                subid -= arc * 40;
+		            }
+		            if (length >= maxLength) return -1;
+		            subids[length++] = subid;
+		            subid = 0;
+		        }
+		        // the last byte says there's more of the last sub-identifier to come
+		        if (view.value[view.length - 1] & 0x80) return -1;
+		        return length;
+		    }
+	};
+	
 	// Primitive types inherits straight off the container, complex come off complexType.
 	// All primitives have to serialise themselves (type, length, data), to be put straight into the packet.
 	// For deserialising from the parent container we check the type, then create an object of that type and call deSerialise,
@@ -49,7 +367,7 @@
 	// If complexType, first split up its children into separate BERs, then passes the child with it's data using the same process.
 	// Complex types have a linked list of BER_CONTAINERS to hold its' children.
 	
-	class BER_CONTAINER	{
+	class BER_CONTAINER : public SNMPArenaAllocated {
 		public:
 		    BER_CONTAINER(bool isPrimative, ASN_TYPE type) : _isPrimative(isPrimative), _type(type){};
 		    virtual ~BER_CONTAINER(){};
@@ -58,14 +376,23 @@
 		    ASN_TYPE _type;
 		    unsigned short _length;
 		    virtual int serialise(unsigned char *buf) = 0;
-		    virtual bool fromBuffer(unsigned char *buf) = 0;
+		    virtual int serialise(BERWriter &writer) = 0; // single pass, back to front
+		    virtual bool fromBuffer(unsigned char *buf, int length) = 0; // length is how much of buf is there to read
 		    virtual int getLength() = 0;
+		    
+		    // whether the whole TLV at buf lies within the length bytes there are
+		    static bool fits(unsigned char *buf, int length)
+		    {
+		        BERView view;
+		        BERReader reader(buf, length);
+		        return length > 0 && reader.next(view);
+		    }
 	};
 	
 	class NetworkAddress : public BER_CONTAINER	{
 		public:
 		    NetworkAddress() : BER_CONTAINER(true, NETWORK_ADDRESS){};
-		    NetworkAddress(IPAddress ip) : _value(ip), BER_CONTAINER(true, NETWORK_ADDRESS){};
+		    NetworkAddress(IPAddress ip) : BER_CONTAINER(true, NETWORK_ADDRESS), _value(ip){};
 		    ~NetworkAddress(){};
 		    
 		    IPAddress _value;
@@ -87,10 +414,21 @@
 		        return _length + 2;
 		    }
 		    
-		    bool fromBuffer(unsigned char *buf)
+		    int serialise(BERWriter &writer)
+		    {
+		        _length = 4;
+		        for (int i = 3; i >= 0; i--)
+		        {
+		            writer.putByte(_value[i]);
+		        }
+		        return _length + writer.putHeader(_type, _length);
+		    }
+		    
+		    bool fromBuffer(unsigned char *buf, int length)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] NetworkAddress:fromBuffer");
 		        
+		        if (!fits(buf, length)) return false;
 		        buf++; // skip Type
 		        _length = *buf;
 		        buf++;
@@ -112,55 +450,56 @@
 	class IntegerType : public BER_CONTAINER {
 		public:
 		    IntegerType() : BER_CONTAINER(true, INTEGER){};
-		    IntegerType(unsigned long value) : _value(value), BER_CONTAINER(true, INTEGER){};
+		    IntegerType(unsigned long value) : BER_CONTAINER(true, INTEGER), _value(value){};
 		    ~IntegerType(){};
 		    
 		    unsigned long _value;
 		    
+		    // INTEGER is signed, the subclasses' Counter32, Gauge32 and TimeTicks are unsigned 32 bits
+		    int contentLength()
+		    {
+		        if (_type == INTEGER)
+		        {
+		            return ber_signed_length((int32_t)_value);
+		        }
+		        return ber_unsigned_length((uint32_t)_value);
+		    }
+		    
 		    int serialise(unsigned char *buf)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] IntergerType:serialise");
 						
 		        // here we print out the BER encoded ASN.1 bytes, which includes type, length and value. we return the length of the entire block (TL&V) in bytes;
 		        unsigned char *ptr = buf;
-		        *ptr = _type;
-		        ptr++;
-		        unsigned char *lengthPtr = ptr++;
-		        if (_value != 0)
-		        {
-		            _length = 4; // FIXME: need to give this dynamic length
-		                         //        while(_length > 1){
-		                         //            if(_value >> 24 == 0){
-		                         //                _length--;
-		                         //                _value = _value << 8;
-		                         //            } else {
-		                         //                break;
-		                         //            }
-		                         //        }
-		            *ptr++ = _value >> 24 & 0xFF;
-		            *ptr++ = _value >> 16 & 0xFF;
-		            *ptr++ = _value >> 8 & 0xFF;
-		            *ptr++ = _value & 0xFF;
-		        }
-		        else
+		        *ptr++ = _type;
+		        uint32_t value = _value;
+		        _length = contentLength();
+		        *ptr++ = _length;
+		        for (int i = _length - 1; i >= 0; i--)
 		        {
-		            _length = 1;
-		            *ptr = 0;
+		            *ptr++ = i < 4 ? value >> (8 * i) & 0xFF : 0;
 		        }
-		        *lengthPtr = _length;
 		        return _length + 2;
 		    }
 		    
-		    bool fromBuffer(unsigned char *buf)
+		    int serialise(BERWriter &writer)
+		    {
+		        _length = contentLength();
+		        writer.putUnsigned((uint32_t)_value, _length);
+		        return _length + writer.putHeader(_type, _length);
+		    }
+		    
+		    bool fromBuffer(unsigned char *buf, int length)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] Integer:fromBuffer");
 		        
+		        if (!fits(buf, length)) return false;
 		        buf++; // skip Type
 		        _length = *buf;
 		        buf++;
 		        unsigned short tempLength = _length;
-		        //        _value = *buf; // TODO: make work for integers more than 255
-		        _value = 0;
+		        // only INTEGER is signed, a negative one has to be sign extended
+		        _value = (_type == INTEGER && tempLength && (*buf & 0x80)) ? ~0UL : 0;
 		        while (tempLength > 0)
 		        {
 		            _value = _value << 8;
@@ -189,63 +528,101 @@
 		    ~TimestampType(){};
 	};
 	
+	// Octet strings are a length and a pointer to bytes someone else owns: the handler's buffer when
+	// answering, the packet when decoded. The bytes have to outlive the object, and may contain NULs.
 	class OctetType : public BER_CONTAINER {
 		public:
 		    OctetType() : BER_CONTAINER(true, STRING){};
-		    OctetType(char *value) : BER_CONTAINER(true, STRING)
+		    OctetType(const char *value) : BER_CONTAINER(true, STRING)
+		    {
+		        _value = (const unsigned char *)value;
+		        _valueLength = value ? strlen(value) : 0;
+		        _length = _valueLength;
+		    };
+		    OctetType(const unsigned char *value, unsigned short length) : BER_CONTAINER(true, STRING)
 		    {
-		        strncpy(_value, value, sizeof(_value));
-		        _value[sizeof(_value)] = 0;
+		        _value = value;
+		        _valueLength = length;
+		        _length = _valueLength;
+		    };
+		    // a copy would free the same bytes again once copy() has made them its own
+		    OctetType(const OctetType &) = delete;
+		    OctetType &operator=(const OctetType &) = delete;
+		    ~OctetType()
+		    {
+		        if (_owned)
+		        {
+		            SNMPArenaAllocated::operator delete((void *)_value);
+		        }
 		    };
-		    ~OctetType(){};
 		    
-		    char _value[SNMP_OCTETSTRING_MAX_LENGTH];
+		    const unsigned char *_value = 0; // not null terminated, see _valueLength
+		    unsigned short _valueLength = 0;
+		    
+		    // for bytes that won't last until the packet is written: takes a copy, out of the
+		    // request arena when there is one
+		    void copy()
+		    {
+		        if (_owned || !_valueLength)
+		        {
+		            return;
+		        }
+		        unsigned char *copied = (unsigned char *)SNMPArenaAllocated::operator new(_valueLength);
+		        memcpy(copied, _value, _valueLength);
+		        _value = copied;
+		        _owned = true;
+		    }
 		    
 		    int serialise(unsigned char *buf)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] OctetType:serialise");
 		        
 		        // here we print out the BER encoded ASN.1 bytes, which includes type, length and value.
-		        char *ptr = (char *)buf;
-		        int numExtraBytes = 0;
-		        char temp[SNMP_OCTETSTRING_MAX_LENGTH];
-		        int valueLength = sprintf(temp, "%s", _value);
-						
+		        unsigned char *ptr = buf;
+		        _length = _valueLength;
 		        *ptr++ = _type; // Set the type identifier
 		        // If > 127 first byte needs to be 0x8x where x is the how many bytes follow which defines string length
-		        if (valueLength > 127)
+		        if (_length > 255)
 		        {
-		            numExtraBytes++;       // Need an extra byte
-		            if (valueLength > 256) // Max 65,536 characters, but likely will fail due to UDP packet fragmentation.
-		            {
-		                numExtraBytes++; // Need another extra byte to store the length
-		            }
-		            *ptr++ = (numExtraBytes | 0x80); // 0x8x where x is the number of bytes which provide the total string length
-		            if (valueLength > 256)
-		            {
-		                *ptr++ = valueLength / 256;
-		                valueLength = valueLength % 256;
-		            }
-		            *ptr++ = valueLength;
+		            *ptr++ = 0x82;
+		            *ptr++ = _length >> 8;
+		            *ptr++ = _length & 0xFF;
+		        }
+		        else if (_length > 127)
+		        {
+		            *ptr++ = 0x81;
+		            *ptr++ = _length;
 		        }
 		        else
 		        {
-		            *ptr++ = valueLength;
+		            *ptr++ = _length;
 		        }
-		        _length = sprintf(ptr, "%s", _value);
-		        return _length + numExtraBytes + 2;
+		        memcpy(ptr, _value, _length);
+		        return (ptr - buf) + _length;
+		    }
+		    
+		    int serialise(BERWriter &writer)
+		    {
+		        _length = _valueLength;
+		        writer.putBytes(_value, _length);
+		        return _length + writer.putHeader(_type, _length);
 		    }
 		    
-		    bool fromBuffer(unsigned char *buf)
+		    bool fromBuffer(unsigned char *buf, int length)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] OctetType:fromBuffer");
 		        
+		        if (!fits(buf, length)) return false;
 		        buf++; // skip Type
 		        _length = *buf;
 		        // length should be treated as: if first byte is 0x8x, the x is how many bytes follow
 		        if (_length > 127)
 		        {
-		            int numBytes = _length &= 0x7F;
+		            int numBytes = _length & 0x7F;
+		            if (numBytes > 2)
+		            {
+		                return false;
+		            }
 		            unsigned int special_length = 0;
 		            for (int k = 0; k < numBytes; k++)
 		            {
@@ -256,17 +633,8 @@
 		            _length = special_length;
 		        }
 		        buf++;
-		        memset(_value, 0, sizeof(_value)); // Null out _value
-		        if (_length < sizeof(_value))
-		        {
-		            strncpy(_value, (char *)buf, _length); // Copy buffer to Value, using length from ASN structure.
-		        }
-		        else
-		        {
-		            Snmp_Serial_println(F("OctetString too large, adjust SNMP_OCTETSTRING_MAX_LENGTH. String Truncated."));
-		            
-		            strncpy(_value, (char *)buf, 253); // Copy truncated buffer to Value
-		        }
+		        _value = buf; // a view into the buffer, nothing is copied
+		        _valueLength = _length;
 		        return true;
 		    }
 		    
@@ -274,6 +642,9 @@
 		    {
 		        return _length;
 		    }
+		    
+		private:
+		    bool _owned = false;
 	};
 	
 	class OIDType : public BER_CONTAINER {
@@ -281,122 +652,81 @@
 		    OIDType() : BER_CONTAINER(true, OID){};
 		    OIDType(char *value) : BER_CONTAINER(true, OID)
 		    {
-		        strncpy(_value, value, MAX_OID_LENGTH);
+		        uint32_t parsed[MAX_OID_SUBIDENTIFIERS];
+		        setValue(parsed, oid_parse(value, parsed, MAX_OID_SUBIDENTIFIERS));
+		    };
+		    OIDType(const uint32_t *value, int length) : BER_CONTAINER(true, OID)
+		    {
+		        setValue(value, length);
 		    };
-		    ~OIDType(){};
+		    OIDType(const OIDType &) = delete;
+		    OIDType &operator=(const OIDType &) = delete;
+		    ~OIDType()
+		    {
+		        SNMPArenaAllocated::operator delete(_value);
+		    };
+		    
+		    // only as many sub-identifiers as the OID has, out of the request arena when there is one
+		    uint32_t *_value = 0;
+		    uint8_t _valueLength = 0;
+		    
+		    void setValue(const uint32_t *value, int length)
+		    {
+		        SNMPArenaAllocated::operator delete(_value);
+		        _value = 0;
+		        _valueLength = length > 0 ? MIN(length, MAX_OID_SUBIDENTIFIERS) : 0;
+		        if (_valueLength)
+		        {
+		            _value = (uint32_t *)SNMPArenaAllocated::operator new(_valueLength * sizeof(uint32_t));
+		            memcpy(_value, value, _valueLength * sizeof(uint32_t));
+		        }
+		    }
 		    
-		    char _value[MAX_OID_LENGTH];
+		    int toString(char *buf, int bufLength)
+		    {
+		        return oid_format(_value, _valueLength, buf, bufLength);
+		    }
 		    
 		    int serialise(unsigned char *buf)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] OIDType:serialise");
 		        
-		        // here we print out the BER encoded ASN.1 bytes, which includes type, length and value.
-		        char *ptr = (char *)buf;
-		        *ptr = _type;
-		        ptr++;
-		        char *lengthPtr = ptr;
-		        ptr++;
-		        *ptr = 0x2b;
-		        char *internalPtr = ++ptr;
-		        char *valuePtr = &_value[5];
-		        _length = 3;
-		        bool toBreak = false;
-		        while (true)
-		        {
-		            char *start = valuePtr;
-		            char *end = strchr(start, '.');
-								
-		            if (!end)
-		            {
-		                end = strchr(start, 0);
-		                toBreak = true;
-		            }
-		            char tempBuf[10];
-		            memset(tempBuf, 0, 10);
-		            //            char* tempBuf = (char*) malloc(sizeof(char) * (end-start));
-		            strncpy(tempBuf, start, end - start + 1);
-		            long tempVal;
-		            tempVal = atoi(tempBuf);
-		            if (tempVal > 127)
-		            {
-		                // Snmp_Serial_print("large num: ");		Snmp_Serial_println(tempVal);
-		                if (tempVal / 128 > 128)
-		                {
-		                    *ptr++ = ((tempVal / 128 / 128) | 0x80) & 0xFF; // dodgy
-		                    _length += 1;
-		                }
-		                *ptr++ = ((tempVal / 128) | 0x80) & 0xFF;
-		                *ptr++ = tempVal % 128 & 0xFF;
-		                _length += 2;
-		            }
-		            else
-		            {
-		                _length += 1;
-		                *ptr++ = (char)tempVal;
-		            }
-								
-		            valuePtr = end + 1;
-								
-		            //            free(tempBuf);
-		            if (toBreak)
-		                break;
-		            // delay(1);
+		        // size it first so the header can go in front, then copy the encoding over
+		        unsigned char temp[MAX_OID_SUBIDENTIFIERS * 5 + 4];
+		        BERWriter writer(temp, sizeof(temp));
+		        int length = serialise(writer);
+		        memcpy(buf, writer.data(), length);
+		        return length;
+		    }
+		    
+		    int serialise(BERWriter &writer)
+		    {
+		        int before = writer.length();
+		        for (int i = _valueLength - 1; i >= 2; i--)
+		        {
+		            writer.putSubidentifier(_value[i]);
 		        }
-		        *lengthPtr = _length - 2;
-						
-		        return _length;
+		        // the first two arcs share a single sub-identifier
+		        uint32_t first = _valueLength > 0 ? _value[0] : 0;
+		        uint32_t second = _valueLength > 1 ? _value[1] : 0;
+		        writer.putSubidentifier(first * 40 + second);
+		        
+		        _length = writer.length() - before;
+		        return _length + writer.putHeader(_type, _length);
 		    }
-		   	
-		    bool fromBuffer(unsigned char *buf)
+		    
+		    bool fromBuffer(unsigned char *buf, int length)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] OIDType:fromBuffer");
 		        
-		        buf++; // skip Type
-		        _length = *buf;
-		        buf++;
-		        buf++;
-		        memset(_value, 0, 128);
-		        _value[0] = '.';
-		        _value[1] = '1';
-		        _value[2] = '.';
-		        _value[3] = '3'; // we fill in the first two bytes already
-		        char *ptr = &_value[4];
-		        char i = _length - 1;
-		        while (i > 0)
-		        {
-		            if (*buf < 128)
-		            { // we can keep raw
-		                ptr += sprintf(ptr, ".%d", *buf);
-		                i--;
-		                buf++;
-		            }
-		            else
-		            {                                   // we have to do the special >128 thing
-		                long value = 0;                 // keep track of the actual thing
-		                unsigned char n = 0;            // count how many large bits have been set
-		                unsigned char tempBuf[6] = {0}; // no bigger than 4 bytes
-		                while (*buf > 127)
-		                {
-		                    i--;
-		                    *buf &= 0x7F;
-		                    tempBuf[n] = *buf;
-		                    n++;
-		                    buf++;
-		                }
-		                value = *buf;
-		                buf++;
-		                i--;
-		                for (unsigned char k = 0; k < n; k++)
-		                {
-		                    value += (pow(128, (n - k))) * tempBuf[k];
-		                }
-		                ptr += sprintf(ptr, ".%d", value);
-		            }
-		        }
-		        // Snmp_Serial_print("OID: " );		Snmp_Serial_println(_value);
-		        //        memcpy(_value, buf, _length);
-		        return true;
+		        BERView view;
+		        BERReader reader(buf, length);
+		        if (!reader.next(view) || view.type != OID) return false;
+		        _length = view.length;
+		        uint32_t decoded[MAX_OID_SUBIDENTIFIERS];
+		        int subids = BERReader::readOID(view, decoded, MAX_OID_SUBIDENTIFIERS);
+		        setValue(decoded, subids);
+		        return subids > 0;
 		    }
 				
 		    int getLength()
@@ -424,10 +754,16 @@
 		        return 2;
 		    }
 		    
-		    bool fromBuffer(unsigned char *buf)
+		    int serialise(BERWriter &writer)
+		    {
+		        return writer.putHeader(_type, 0);
+		    }
+		    
+		    bool fromBuffer(unsigned char *buf, int length)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] NullType:fromBuffer");
 		        
+		        if (!fits(buf, length)) return false;
 		        _length = 0;
 		        return true;
 		    }
@@ -441,7 +777,7 @@
 	class Counter64 : public BER_CONTAINER {
 		public:
 		    Counter64() : BER_CONTAINER(true, COUNTER64){};
-		    Counter64(uint64_t value) : _value(value), BER_CONTAINER(true, COUNTER64){};
+		    Counter64(uint64_t value) : BER_CONTAINER(true, COUNTER64), _value(value){};
 		    ~Counter64(){};
 		    
 		    uint64_t _value;
@@ -452,34 +788,28 @@
 		        
 		        // here we print out the BER encoded ASN.1 bytes, which includes type, length and value. we return the length of the entire block (TL&V) ni bytes;
 		        unsigned char *ptr = buf;
-		        *ptr = _type;
-		        ptr++;
-		        unsigned char *lengthPtr = ptr++;
-		        if (_value != 0)
-		        {
-		            _length = 8;
-		            *ptr++ = _value >> 56 & 0xFF;
-		            *ptr++ = _value >> 48 & 0xFF;
-		            *ptr++ = _value >> 40 & 0xFF;
-		            *ptr++ = _value >> 32 & 0xFF;
-		            *ptr++ = _value >> 24 & 0xFF;
-		            *ptr++ = _value >> 16 & 0xFF;
-		            *ptr++ = _value >> 8 & 0xFF;
-		            *ptr++ = _value & 0xFF;
-		        }
-		        else
+		        *ptr++ = _type;
+		        _length = ber_unsigned_length(_value);
+		        *ptr++ = _length;
+		        for (int i = _length - 1; i >= 0; i--)
 		        {
-		            _length = 1;
-		            *ptr = 0;
+		            *ptr++ = i < 8 ? _value >> (8 * i) & 0xFF : 0;
 		        }
-		        *lengthPtr = _length;
 		        return _length + 2;
 		    }
 		    
-		    bool fromBuffer(unsigned char *buf)
+		    int serialise(BERWriter &writer)
+		    {
+		        _length = ber_unsigned_length(_value);
+		        writer.putUnsigned(_value, _length);
+		        return _length + writer.putHeader(_type, _length);
+		    }
+		    
+		    bool fromBuffer(unsigned char *buf, int length)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] Counter64:fromBuffer");
 		        
+		        if (!fits(buf, length)) return false;
 		        buf++; // skip Type
 		        _length = *buf;
 		        buf++;
@@ -527,12 +857,33 @@
 		    ~Guage(){};
 	};
 	
-	typedef struct BER_LINKED_LIST
+	// reverses a list linked through next in place and hands back the new head. Reversing, walking and
+	// reversing back writes a list back to front without recursing once per entry
+	template <typename Node> inline Node* reverse_list(Node* head)
+	{
+	    Node* previous = 0;
+	    while (head)
+	    {
+	        Node* next = head->next;
+	        head->next = previous;
+	        previous = head;
+	        head = next;
+	    }
+	    return previous;
+	}
+	
+	typedef struct BER_LINKED_LIST : public SNMPArenaAllocated
 	{
 	    ~BER_LINKED_LIST()
 	    {
-	        delete next;
-	        next = 0;
+	        // the rest of the list is unlinked and deleted a node at a time rather than recursively
+	        while (next)
+	        {
+	            struct BER_LINKED_LIST *node = next;
+	            next = node->next;
+	            node->next = 0;
+	            delete node;
+	        }
 	        delete value;
 	        value = 0;
 	    }
@@ -551,10 +902,30 @@
 		    
 		    ValuesList *_values = 0;
 		    
-		    bool fromBuffer(unsigned char *buf)
+		    int serialise(BERWriter &writer)
+		    {
+		        int actualLength = serialiseList(_values, writer);
+		        return actualLength + writer.putHeader(_type, actualLength);
+		    }
+		    
+		    // children have to go in last to first, so the list is turned round for the walk and back after it
+		    static int serialiseList(ValuesList *conductor, BERWriter &writer)
+		    {
+		        ValuesList *last = reverse_list(conductor);
+		        int length = 0;
+		        for (ValuesList *node = last; node; node = node->next)
+		        {
+		            length += node->value->serialise(writer);
+		        }
+		        reverse_list(last);
+		        return length;
+		    }
+		    
+		    bool fromBuffer(unsigned char *buf, int length)
 		    {
 		        Snmp_Serial_println("[DEBUG_BER] ComplexType:fromBuffer");
 		        
+		        if (!fits(buf, length)) return false;
 		        // the buffer we get passed in is the complete ASN Container, including the type header.
 		        buf++; // Skip our own type
 		        _length = *buf;
@@ -572,9 +943,10 @@
 		            _length = special_length;
 		        }
 		        buf++;
+		        unsigned char *end = buf + _length; // fits() has made sure it's all there
 		        // now we are at the front of a list of one or many other types, lets do our loop
 		        unsigned int i = 1;
-		        while (i < _length)
+		        while (i < _length && buf < end)
 		        {
 		            ASN_TYPE valueType = (ASN_TYPE)*buf;
 		            buf++;
@@ -609,7 +981,9 @@
 		            case SetRequestPDU:
 		            case GetBulkRequestPDU:
 		            case TrapPDU: // should never get trap, but put it in anyway
+		            case InformRequestPDU:
 		            case Trapv2PDU:
+		            case ReportPDU:
 		                newObj = new ComplexType(valueType);
 		                break;
 		                // primitive
@@ -649,7 +1023,7 @@
 		                newObj = new ComplexType(valueType);
 		                break;
 		            }
-		            newObj->fromBuffer(buf - (2 + doubleL));
+		            newObj->fromBuffer(buf - (2 + doubleL), end - (buf - (2 + doubleL)));
 								
 		            buf += valueLength;
 		            i += valueLength;
@@ -0,0 +1,176 @@
+#ifndef SNMPArena_h
+	#define SNMPArena_h
+	
+	#ifndef SNMP_ARENA_SIZE
+		#if defined(ESP32) || !defined(ARDUINO)
+			#define SNMP_ARENA_SIZE (SNMP_PACKET_LENGTH * 4)  // Everything allocated while answering one request should fit in here, anything more comes off the heap and is counted in spills. A decoded varbind takes about 150 bytes, so this holds a few dozen. A GetBulk that fills the packet spills, raise this if that's the usual request
+		#elif defined(ESP8266)
+			#define SNMP_ARENA_SIZE 2048  // a dozen or so varbinds, a request with more spills
+		#else
+			#define SNMP_ARENA_SIZE 2048
+		#endif
+	#endif
+	
+	#ifndef SNMP_THREAD_LOCAL
+		#if defined(ESP32) || !defined(ARDUINO)
+			#define SNMP_THREAD_LOCAL thread_local  // the agent's task and the sketch can both be building packets at once, each has its own current arena
+		#else
+			#define SNMP_THREAD_LOCAL
+		#endif
+	#endif
+	
+	#include <stddef.h>
+	#include <stdint.h>
+	#include "SNMPTask.h"
+	
+	// A bump allocator for the objects built while answering one request. Allocating is moving a
+	// pointer, freeing a single object does nothing, and the whole lot is released at once by reset().
+	// When it runs out the allocation falls back to the heap and is counted, so SNMP_ARENA_SIZE can be tuned.
+	class SNMPArena {
+		public:
+		    SNMPArena()
+		    {
+		        SNMPMutexGuard guard(registryLock());
+		        _nextArena = arenas;
+		        arenas = this;
+		    };
+		    ~SNMPArena()
+		    {
+		        SNMPMutexGuard guard(registryLock());
+		        for(SNMPArena** arena = &arenas; *arena; arena = &(*arena)->_nextArena){
+		            if(*arena == this){
+		                *arena = _nextArena;
+		                break;
+		            }
+		        }
+		    };
+		    SNMPArena(const SNMPArena&) = delete;
+		    SNMPArena& operator=(const SNMPArena&) = delete;
+	
+		    void* allocate(size_t size)
+		    {
+		        size = (size + 7) & ~(size_t)7; // keeps uint64_t members aligned
+		        if(size > sizeof(_storage) - _used){
+		            return 0;
+		        }
+		        void* pointer = (unsigned char*)_storage + _used;
+		        _used += size;
+		        if(_used > highWater){
+		            highWater = _used;
+		        }
+		        return pointer;
+		    }
+	
+		    bool owns(void* pointer)
+		    {
+		        return pointer >= (void*)_storage && pointer < (void*)(_storage + sizeof(_storage) / sizeof(_storage[0]));
+		    }
+		    
+		    // whether any arena does, whichever one is current, so nothing out of one is ever handed to free()
+		    static bool anyOwns(void* pointer)
+		    {
+		        SNMPArena* current = SNMPArena::current;
+		        if(current && current->owns(pointer)){
+		            return true;
+		        }
+		        SNMPMutexGuard guard(registryLock());
+		        for(SNMPArena* arena = arenas; arena; arena = arena->_nextArena){
+		            if(arena->owns(pointer)){
+		                return true;
+		            }
+		        }
+		        return false;
+		    }
+	
+		    void reset()
+		    {
+		        if(_used + spilledBytes > peakRequest){
+		            peakRequest = _used + spilledBytes;
+		        }
+		        _used = 0;
+		        spills = 0;
+		        spilledBytes = 0;
+		    }
+	
+		    size_t used()
+		    {
+		        return _used;
+		    }
+	
+		    size_t capacity()
+		    {
+		        return sizeof(_storage);
+		    }
+	
+		    size_t highWater = 0;        // most of the arena any one request has needed
+		    unsigned long spills = 0;    // allocations since the last reset that didn't fit and went to the heap
+		    unsigned long totalSpills = 0;
+		    size_t spilledBytes = 0;     // what those allocations came to
+		    size_t peakRequest = 0;      // most any one request has taken, arena and heap together
+	
+		    static SNMP_THREAD_LOCAL SNMPArena* current;   // where SNMPArenaAllocated objects come from right now on this thread, 0 for the heap
+		    static SNMPArena* arenas;                      // every arena there is, one per agent, linked through _nextArena
+	
+		private:
+		    // agents, and so arenas, can come and go on more than one task. Made on first use so it's
+		    // there for an agent that's a global
+		    static SNMPMutex& registryLock()
+		    {
+		        static SNMPMutex lock;
+		        return lock;
+		    }
+	
+		    uint64_t _storage[(SNMP_ARENA_SIZE + 7) / 8];
+		    size_t _used = 0;
+		    SNMPArena* _nextArena = 0;
+	};
+	
+	SNMP_THREAD_LOCAL SNMPArena* SNMPArena::current = 0;
+	SNMPArena* SNMPArena::arenas = 0;
+	
+	// Routes a class' new and delete to the current arena. Inherited by the BER containers and the
+	// lists the response is built from.
+	struct SNMPArenaAllocated {
+		    static void* operator new(size_t size)
+		    {
+		        SNMPArena* arena = SNMPArena::current;
+		        if(arena){
+		            void* pointer = arena->allocate(size);
+		            if(pointer){
+		                return pointer;
+		            }
+		            arena->spills++;
+		            arena->totalSpills++;
+		            arena->spilledBytes += size;
+		        }
+		        return ::operator new(size);
+		    }
+	
+		    static void operator delete(void* pointer)
+		    {
+		        if(SNMPArena::anyOwns(pointer)){
+		            return; // released with the rest of its arena, even once that's no longer the current one
+		        }
+		        ::operator delete(pointer);
+		    }
+	};
+	
+	// Makes an arena current for as long as it's in scope, and empties it on the way out.
+	class SNMPArenaScope {
+		public:
+		    SNMPArenaScope(SNMPArena* arena) : _arena(arena), _previous(SNMPArena::current)
+		    {
+		        SNMPArena::current = arena;
+		    };
+		    ~SNMPArenaScope()
+		    {
+		        _arena->reset();
+		        SNMPArena::current = _previous;
+		    };
+	
+		private:
+		    SNMPArena* _arena;
+		    SNMPArena* _previous;
+	};
+	
+#endif
@@ -0,0 +1,206 @@
+// MIB-II (RFC 1213) for SNMPAgent::enableRFC1213(): the system group, and the interfaces group as a
+// table whose rows come from an SNMPInterfaceProvider. Everything a request reads is set up when the
+// group is enabled, answering one allocates nothing more than any other handler does.
+
+#ifndef SNMPMIB2_h
+	#define SNMPMIB2_h
+	
+	#ifndef SNMP_SYSTEM_STRING_LENGTH
+		#if defined(ESP32) || defined(ESP8266) || !defined(ARDUINO)
+			#define SNMP_SYSTEM_STRING_LENGTH 64  // longest sysContact, sysName or sysLocation a manager can set, the terminator included
+		#else
+			#define SNMP_SYSTEM_STRING_LENGTH 24
+		#endif
+	#endif
+	
+	#define RFC1213_OID_ifNumber						(char*)(".1.3.6.1.2.1.2.1.0")
+	#define RFC1213_OID_ifEntry							(char*)(".1.3.6.1.2.1.2.2.1")
+	
+	// sysUpTime in hundredths of a second, worked out from millis() whenever it's read. It carries on past
+	// millis() wrapping every 49.7 days as long as tick() runs in between, which loop() sees to
+	class UptimeCallback: public TimestampCallback {
+	  public:
+	    UptimeCallback()
+	    {
+	        value = &_ticks;
+	    };
+	
+	    void refresh()
+	    {
+	        tick();
+	        _ticks = (int)(uint32_t)((((uint64_t)_wraps << 32) | _lastMillis) / 10);
+	    }
+	
+	    void tick()
+	    {
+	        uint32_t now = millis();
+	        if(now < _lastMillis){
+	            _wraps++;
+	        }
+	        _lastMillis = now;
+	    }
+	
+	    uint32_t ticks()
+	    {
+	        refresh();
+	        return (uint32_t)_ticks;
+	    }
+	
+	  private:
+	    int _ticks = 0;
+	    uint32_t _lastMillis = 0;
+	    uint32_t _wraps = 0;
+	};
+	
+	// The system group's settable strings live here, so a manager's Set lands in the agent and the
+	// sketch can read it back (and save it) once setOccurred goes up
+	typedef struct SNMPSystemGroupStruct
+	{
+	    const char* descr = 0;                          // sysDescr
+	    char* objectID = 0;                             // sysObjectID, the OID as a string
+	    char contact[SNMP_SYSTEM_STRING_LENGTH] = {0};  // sysContact
+	    char name[SNMP_SYSTEM_STRING_LENGTH] = {0};     // sysName
+	    char location[SNMP_SYSTEM_STRING_LENGTH] = {0}; // sysLocation
+	    int services = 72;                              // sysServices, layers 4 and 7: a host offering applications
+	} SNMPSystemGroup;
+	
+	// One row of ifTable. ifSpecific isn't served, RFC 2863 deprecated it
+	typedef struct SNMPInterfaceStruct
+	{
+	    const char* descr = "";             // ifDescr, has to last until the response has gone
+	    int type = 6;                       // ifType, 6 ethernetCsmacd, 71 ieee80211, 24 softwareLoopback
+	    int mtu = 1500;
+	    uint32_t speed = 0;                 // bits per second
+	    uint8_t physAddress[8] = {0};       // ifPhysAddress, the MAC
+	    uint8_t physAddressLength = 6;
+	    int adminStatus = 1;                // 1 up, 2 down, 3 testing
+	    int operStatus = 1;
+	    uint32_t lastChange = 0;            // sysUpTime when operStatus last changed
+	    uint32_t inOctets = 0;
+	    uint32_t inUcastPkts = 0;
+	    uint32_t inNUcastPkts = 0;
+	    uint32_t inDiscards = 0;
+	    uint32_t inErrors = 0;
+	    uint32_t inUnknownProtos = 0;
+	    uint32_t outOctets = 0;
+	    uint32_t outUcastPkts = 0;
+	    uint32_t outNUcastPkts = 0;
+	    uint32_t outDiscards = 0;
+	    uint32_t outErrors = 0;
+	    uint32_t outQLen = 0;
+	} SNMPInterface;
+	
+	// Where the interfaces group comes from. Interfaces are numbered 1 to count(), which is ifNumber, and
+	// read() fills in one of them. Cells of the same interface asked for one after the other in a request
+	// come from one read(), so a poll of a row's counters gets numbers that agree with each other
+	class SNMPInterfaceProvider {
+	  public:
+	    virtual ~SNMPInterfaceProvider(){};
+	    virtual uint32_t count() = 0;
+	    virtual bool read(uint32_t index, SNMPInterface& interface) = 0;
+	};
+	
+	// ifTable for one agent, rows read from that agent's provider. Each agent that enables the interfaces
+	// group gets its own, so two agents can serve different interfaces. A row is read once per request,
+	// going by the number of the request that agent is answering
+	class SNMPInterfaces: public TableCallback {
+	  public:
+	    SNMPInterfaces(SNMPInterfaceProvider* provider, const uint32_t* request): provider(provider), _agentRequest(request)
+	    {
+	        // every column but ifSpecific. The row is the ifIndex
+	        static const ASN_TYPE types[] = {INTEGER, STRING, INTEGER, INTEGER, GUAGE32, STRING, INTEGER, INTEGER, TIMESTAMP,
+	            COUNTER32, COUNTER32, COUNTER32, COUNTER32, COUNTER32, COUNTER32,
+	            COUNTER32, COUNTER32, COUNTER32, COUNTER32, COUNTER32, GUAGE32};
+	        for(uint32_t number = 1; number <= sizeof(types) / sizeof(types[0]); number++){
+	            SNMPTableColumn column = SNMPTableColumn();
+	            column.number = number;
+	            column.type = types[number - 1];
+	            column.bytes = number == 6;
+	            addColumn(column);
+	        }
+	    };
+	
+	    SNMPInterfaceProvider* provider;
+	
+	    uint32_t count()
+	    {
+	        return provider ? provider->count() : 0;
+	    }
+	
+	    SNMPInterface& row(uint32_t index)
+	    {
+	        uint32_t request = *_agentRequest;
+	        if(index != _index || request != _request){
+	            _row = SNMPInterface();
+	            if(!provider || !provider->read(index, _row)){
+	                _row.operStatus = 2;
+	            }
+	            _index = index;
+	            _request = request;
+	        }
+	        return _row;
+	    }
+	
+	  protected:
+	    uint32_t rowAfter(uint32_t row)
+	    {
+	        return row < count() ? row + 1 : 0;
+	    }
+	
+	    void readColumn(SNMPTableColumn* column, uint32_t index)
+	    {
+	        SNMPInterface& interface = row(index);
+	        switch(column->number){
+	            case 1:  _integer = index;                      break;
+	            case 2:  _string = (char*)interface.descr; _stringLength = -1; break;
+	            case 3:  _integer = interface.type;             break;
+	            case 4:  _integer = interface.mtu;              break;
+	            case 5:  _unsigned32 = interface.speed;         break;
+	            case 6:
+	                _string = (char*)interface.physAddress;
+	                _stringLength = MIN(interface.physAddressLength, sizeof(interface.physAddress));
+	                break;
+	            case 7:  _integer = interface.adminStatus;      break;
+	            case 8:  _integer = interface.operStatus;       break;
+	            case 9:  _integer = interface.lastChange;       break;
+	            case 10: _unsigned32 = interface.inOctets;      break;
+	            case 11: _unsigned32 = interface.inUcastPkts;   break;
+	            case 12: _unsigned32 = interface.inNUcastPkts;  break;
+	            case 13: _unsigned32 = interface.inDiscards;    break;
+	            case 14: _unsigned32 = interface.inErrors;      break;
+	            case 15: _unsigned32 = interface.inUnknownProtos; break;
+	            case 16: _unsigned32 = interface.outOctets;     break;
+	            case 17: _unsigned32 = interface.outUcastPkts;  break;
+	            case 18: _unsigned32 = interface.outNUcastPkts; break;
+	            case 19: _unsigned32 = interface.outDiscards;   break;
+	            case 20: _unsigned32 = interface.outErrors;     break;
+	            case 21: _unsigned32 = interface.outQLen;       break;
+	        }
+	    }
+	
+	  private:
+	    SNMPInterface _row;
+	    uint32_t _index = 0;
+	    uint32_t _request = 0;
+	    const uint32_t* _agentRequest;
+	};
+	
+	// ifNumber, read from the same agent's ifTable
+	class SNMPInterfaceCount: public IntegerCallback {
+	  public:
+	    SNMPInterfaceCount(SNMPInterfaces* interfaces): _interfaces(interfaces)
+	    {
+	        value = &_count;
+	    };
+	
+	    void refresh()
+	    {
+	        _count = _interfaces->count();
+	    }
+	
+	  private:
+	    SNMPInterfaces* _interfaces;
+	    int _count = 0;
+	};
+	
+#endif
@@ -0,0 +1,181 @@
+// Values a producer (an interrupt, another task, the other core) publishes for the agent to read,
+// without either side taking a lock. Each group of values has a sequence number the producer makes
+// odd while it's writing and even again when it's done; the agent copies the whole group out and
+// tries again if the number moved under it. So a 64 bit counter is never read half updated, and
+// values updated together in one group are read together, however many varbinds they're spread over.
+//
+// One producer per group: an interrupt and a task both writing the same group need to keep out of
+// each other's way themselves. One reader too: the copy is a single snapshot per value, written by
+// whichever agent is answering under its lock. A group read by two agents, or by a trap sent with
+// SNMPTrap::sendTo() while its agent runs in a task, needs those readers kept apart by the sketch.
+
+#ifndef SNMPPublished_h
+	#define SNMPPublished_h
+	
+	#ifndef SNMP_PUBLISHED_SPINS
+		#define SNMP_PUBLISHED_SPINS 64  // attempts at a clean copy before the reader sleeps a tick, in case the producer was preempted mid-write
+	#endif
+	
+	class SNMPPublishedGroup;
+	
+	class SNMPPublishedValue {
+		public:
+		    SNMPPublishedGroup* group = 0;
+	
+		protected:
+		    friend class SNMPPublishedGroup;
+		    SNMPPublishedValue* _nextInGroup = 0;
+		    void join(SNMPPublishedGroup* group);
+		    virtual void keep() = 0; // copies what's been published into the reader's snapshot
+	};
+	
+	class SNMPPublishedGroup {
+		public:
+		    SNMPPublishedGroup(){};
+		    // its values point back at it
+		    SNMPPublishedGroup(const SNMPPublishedGroup&) = delete;
+		    SNMPPublishedGroup& operator=(const SNMPPublishedGroup&) = delete;
+	
+		    // producer side, around a set of updates that belong together. They nest, so the set() calls
+		    // in between become part of the one update
+		    void beginUpdate()
+		    {
+		        if(_depth++ == 0){
+		            __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELAXED);
+		            __atomic_thread_fence(__ATOMIC_RELEASE);
+		        }
+		    }
+	
+		    void endUpdate()
+		    {
+		        if(--_depth == 0){
+		            __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELEASE);
+		        }
+		    }
+	
+		    // reader side: a consistent copy of every value in the group, taken once per request however
+		    // many of its values the request asks for
+		    void snapshot(uint32_t request);
+	
+		    // numbers requests, so a group isn't copied again halfway through answering one. The numbers
+		    // are unique across agents and tasks, and each task has its own current one, so a request
+		    // never takes another's copy for its own
+		    static uint32_t newRequest()
+		    {
+		        uint32_t request = __atomic_add_fetch(&_requests, 1, __ATOMIC_RELAXED);
+		        if(request == 0){
+		            request = __atomic_add_fetch(&_requests, 1, __ATOMIC_RELAXED);
+		        }
+		        _currentRequest = request;
+		        return request;
+		    }
+	
+		    static uint32_t currentRequest()
+		    {
+		        return _currentRequest;
+		    }
+	
+		private:
+		    friend class SNMPPublishedValue;
+		    uint32_t _sequence = 0;
+		    uint8_t _depth = 0;
+		    uint32_t _snapshotRequest = 0;
+		    SNMPPublishedValue* _values = 0;
+		    static uint32_t _requests;
+		    static SNMP_THREAD_LOCAL uint32_t _currentRequest;
+	};
+	
+	uint32_t SNMPPublishedGroup::_requests = 0;
+	SNMP_THREAD_LOCAL uint32_t SNMPPublishedGroup::_currentRequest = 0;
+	
+	void SNMPPublishedGroup::snapshot(uint32_t request)
+	{
+	    if(request && request == _snapshotRequest){
+	        return;
+	    }
+	    for(int attempt = 1;; attempt++){
+	        uint32_t before = __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE);
+	        if(!(before & 1)){
+	            for(SNMPPublishedValue* value = _values; value; value = value->_nextInGroup){
+	                value->keep();
+	            }
+	            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+	            if(__atomic_load_n(&_sequence, __ATOMIC_RELAXED) == before){
+	                break;
+	            }
+	        }
+	        if(attempt % SNMP_PUBLISHED_SPINS == 0){
+	            delay(1);
+	        }
+	    }
+	    _snapshotRequest = request;
+	}
+	
+	void SNMPPublishedValue::join(SNMPPublishedGroup* group)
+	{
+	    this->group = group;
+	    _nextInGroup = group->_values;
+	    group->_values = this;
+	}
+	
+	// One published value. The producer calls set() or add(), the agent reads snapshot. Without a
+	// group it's a group of one
+	template <typename T>
+	class SNMPPublished: public SNMPPublishedValue {
+		public:
+		    SNMPPublished(T initial = T(), SNMPPublishedGroup* group = 0): snapshot(initial), _latest(initial)
+		    {
+		        join(group ? group : &_ownGroup);
+		        publish();
+		    };
+		    SNMPPublished(SNMPPublishedGroup* group): SNMPPublished(T(), group){};
+		    // a copy would be left in the original's group, or in the original's _ownGroup
+		    SNMPPublished(const SNMPPublished&) = delete;
+		    SNMPPublished& operator=(const SNMPPublished&) = delete;
+	
+		    void set(T value)
+		    {
+		        group->beginUpdate();
+		        _latest = value;
+		        publish();
+		        group->endUpdate();
+		    }
+	
+		    void add(T delta)
+		    {
+		        set(_latest + delta);
+		    }
+	
+		    // the producer's own view, what it last set
+		    T value()
+		    {
+		        return _latest;
+		    }
+	
+		    T snapshot; // what the agent last copied out, only the agent should touch it
+	
+		private:
+		    void publish()
+		    {
+		        uint32_t words[sizeof(_published) / sizeof(uint32_t)] = {0};
+		        memcpy(words, &_latest, sizeof(T));
+		        for(unsigned i = 0; i < sizeof(words) / sizeof(uint32_t); i++){
+		            __atomic_store_n(&_published[i], words[i], __ATOMIC_RELAXED);
+		        }
+		    }
+	
+		    void keep()
+		    {
+		        uint32_t words[sizeof(_published) / sizeof(uint32_t)];
+		        for(unsigned i = 0; i < sizeof(words) / sizeof(uint32_t); i++){
+		            words[i] = __atomic_load_n(&_published[i], __ATOMIC_RELAXED);
+		        }
+		        memcpy(&snapshot, words, sizeof(T));
+		    }
+	
+		    T _latest;
+		    uint32_t _published[(sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t)]; // copied a word at a time, so neither side needs a lock
+		    SNMPPublishedGroup _ownGroup;
+	};
+	
+#endif
@@ -15,33 +15,49 @@
 	    DONE
 	};
 	
+	// The request is decoded in place: every field that isn't a plain number is a view into the
+	// packet buffer handed to parseFrom, so the buffer must outlive the request.
 	class SNMPRequest	{
 		public:
 			SNMPRequest(){};
 			
-			~SNMPRequest()
-			{
-				delete varBinds;
-				delete SNMPPacket;
-			};
+			~SNMPRequest(){};
 			
-			char *communityString;
+			unsigned char *communityString = 0; // not null terminated, see communityLength
+			unsigned short communityLength = 0;
 			int version;
 			ASN_TYPE requestType;
 			unsigned long requestID;
 			int errorStatus;
 			int errorIndex;
-			VarBindList *varBinds = 0;
-			VarBindList *varBindsCursor = 0;
-		
-			ComplexType *SNMPPacket = 0;
-			bool parseFrom(unsigned char *buf);
-			bool serialise(char *buf);
+			
+			// GetBulk reuses the error fields
+			int nonRepeaters()
+			{
+				return errorStatus;
+			}
+			int maxRepetitions()
+			{
+				return errorIndex;
+			}
+			
+			BERView varBinds;
+			BERReader varBindsCursor;
+			int varBindCount = 0;
+			
+			bool parseFrom(unsigned char *buf, int length);
+			bool parseScopedPDU(BERView scopedPDU); // the PDU of an SNMPv3 message, once the USM has let it through
+			bool communityMatches(const char *community);
+			void resetVarBinds();
+			bool nextVarBind(VarBind &varbind);
 			enum SNMPExpect EXPECTING = SNMPVERSION;
 			bool isCorrupt = false;
+			
+		private:
+			bool parseFields(BERReader cursor);
 	};
 	
-	bool SNMPRequest::parseFrom(unsigned char *buf)
+	bool SNMPRequest::parseFrom(unsigned char *buf, int length)
 	{
 		// confirm that the packet is a STRUCTURE
 		if (buf[0] != 0x30)
@@ -51,33 +67,56 @@
 			isCorrupt = true;
 			return false;
 		}
-		SNMPPacket = new ComplexType(STRUCTURE); // ensure SNMPPacket is initialised to avoid crash in deconstructor
-		SNMPPacket->fromBuffer(buf);
-	
-		if (SNMPPacket->getLength() <= 30)
+		
+		BERView packet;
+		BERReader reader(buf, length);
+		if (!reader.next(packet))
+		{
+			isCorrupt = true;
+			return false;
+		}
+		
+		if (packet.length <= 30)
 		{
 			Snmp_Serial_println(F("[DEBUG Request] SNMP packet too short, needs to be > 30"));
 			return false;
 		}
 		
-		// we now have a full ASN.1 packet in SNMPPacket
-		ValuesList *cursor = SNMPPacket->_values;
-		ValuesList *tempCursor = NULL;
+		// walk the packet in place, cursor always points at the container we are currently inside
+		return parseFields(BERReader(packet));
+	}
+	
+	bool SNMPRequest::parseScopedPDU(BERView scopedPDU)
+	{
+		// contextEngineID and contextName, then a PDU like any other. Only the default context is served
+		BERReader cursor(scopedPDU);
+		BERView view;
+		if (!cursor.expect(STRING, view) || !cursor.expect(STRING, view))
+		{
+			isCorrupt = true;
+			return false;
+		}
+		// no community in v3, an empty one keeps the rest of the agent as it is
+		communityString = view.value;
+		communityLength = 0;
+		version = 4;
+		EXPECTING = PDU;
+		return parseFields(cursor);
+	}
+	
+	bool SNMPRequest::parseFields(BERReader cursor)
+	{
+		BERView view;
+		long number;
 		
 		while (EXPECTING != DONE)
 		{
 			switch (EXPECTING)
 			{
 			case SNMPVERSION:
-				if (cursor->value->_type == INTEGER)
+				if (cursor.expect(INTEGER, view) && BERReader::readInteger(view, number))
 				{
-					version = ((IntegerType *)cursor->value)->_value + 1;
-					if (!cursor->next)
-					{
-						isCorrupt = true;
-						return false;
-					}
-					cursor = cursor->next;
+					version = number + 1;
 					EXPECTING = COMMUNITY;
 				}
 				else
@@ -87,15 +126,10 @@
 				}
 				break;
 			case COMMUNITY:
-				if (cursor->value->_type == STRING)
+				if (cursor.expect(STRING, view))
 				{
-					communityString = ((OctetType *)cursor->value)->_value;
-					if (!cursor->next)
-					{
-						isCorrupt = true;
-						return false;
-					}
-					cursor = cursor->next;
+					communityString = view.value;
+					communityLength = view.length;
 					EXPECTING = PDU;
 				}
 				else
@@ -105,32 +139,32 @@
 				}
 				break;
 			case PDU:
-				switch (cursor->value->_type)
+				if (!cursor.next(view))
+				{
+					isCorrupt = true;
+					return false;
+				}
+				switch (view.type)
 				{
 				case GetRequestPDU:
 				case GetNextRequestPDU:
 				case GetResponsePDU:
 				case SetRequestPDU:
-					requestType = cursor->value->_type;
+				case GetBulkRequestPDU:
+					requestType = view.type;
 					break;
 				default:
 					isCorrupt = true;
 					return false;
 					break;
 				}
-				cursor = ((ComplexType *)cursor->value)->_values;
+				cursor = BERReader(view);
 				EXPECTING = REQUESTID;
 				break;
 			case REQUESTID:
-				if (cursor->value->_type == INTEGER)
+				if (cursor.expect(INTEGER, view) && BERReader::readInteger(view, number))
 				{
-					requestID = ((IntegerType *)cursor->value)->_value;
-					if (!cursor->next)
-					{
-						isCorrupt = true;
-						return false;
-					}
-					cursor = cursor->next;
+					requestID = number;
 					EXPECTING = ERRORSTATUS;
 				}
 				else
@@ -140,15 +174,9 @@
 				}
 				break;
 			case ERRORSTATUS:
-				if (cursor->value->_type == INTEGER)
+				if (cursor.expect(INTEGER, view) && BERReader::readInteger(view, number))
 				{
-					errorStatus = ((IntegerType *)cursor->value)->_value;
-					if (!cursor->next)
-					{
-						isCorrupt = true;
-						return false;
-					}
-					cursor = cursor->next;
+					errorStatus = number;
 					EXPECTING = ERRORID;
 				}
 				else
@@ -158,15 +186,9 @@
 				}
 				break;
 			case ERRORID:
-				if (cursor->value->_type == INTEGER)
+				if (cursor.expect(INTEGER, view) && BERReader::readInteger(view, number))
 				{
-					errorIndex = ((IntegerType *)cursor->value)->_value;
-					if (!cursor->next)
-					{
-						isCorrupt = true;
-						return false;
-					}
-					cursor = cursor->next;
+					errorIndex = number;
 					EXPECTING = VARBINDS;
 				}
 				else
@@ -176,11 +198,9 @@
 				}
 				break;
 			case VARBINDS: // we have a varbind structure, lets dive into it.
-				if (cursor->value->_type == STRUCTURE)
+				if (cursor.expect(STRUCTURE, varBinds))
 				{
-					varBinds = new VarBindList();
-					varBindsCursor = varBinds;
-					tempCursor = ((ComplexType *)cursor->value)->_values;
+					resetVarBinds();
 					EXPECTING = VARBIND;
 				}
 				else
@@ -190,37 +210,52 @@
 				}
 				break;
 			case VARBIND:
-				// we need to keep the cursor outside the varbindlist itself so we always have access to the list
-				if (tempCursor->value->_type == STRUCTURE && ((ComplexType *)tempCursor->value)->_values->value->_type == OID)
-				{
-					VarBind *varbind = new VarBind();
-					varbind->oid = ((OIDType *)((ComplexType *)tempCursor->value)->_values->value);
-					varbind->type = ((ComplexType *)tempCursor->value)->_values->next->value->_type;
-					varbind->value = ((ComplexType *)tempCursor->value)->_values->next->value;
-					varBindsCursor->value = varbind;
-					varBindsCursor->next = new VarBindList();
-					if (!tempCursor->next)
+				// validate every varbind up front, so nextVarBind() can be trusted later on
+				if (varBindsCursor.atEnd())
+				{
+					EXPECTING = DONE;
+				}
+				else
+				{
+					BERReader varbind;
+					BERView oid, value;
+					if (varBindsCursor.expect(STRUCTURE, view) && (varbind = BERReader(view)).expect(OID, oid) && varbind.next(value))
 					{
-						EXPECTING = DONE;
+						varBindCount++;
 					}
 					else
 					{
-						tempCursor = tempCursor->next;
-						varBindsCursor = varBindsCursor->next;
+						isCorrupt = true;
+						return false;
 					}
 				}
-				else
-				{
-					isCorrupt = true;
-					return false;
-				}
 				break;
 			default:
 				break;
 			}
 		}
 		
+		resetVarBinds();
 		return true;
 	}
 	
+	bool SNMPRequest::communityMatches(const char *community)
+	{
+		return community != 0 && strlen(community) == communityLength && memcmp(community, communityString, communityLength) == 0;
+	}
+	
+	void SNMPRequest::resetVarBinds()
+	{
+		varBindsCursor = BERReader(varBinds);
+	}
+	
+	bool SNMPRequest::nextVarBind(VarBind &varbind)
+	{
+		BERView view;
+		if (!varBindsCursor.next(view)) return false;
+		
+		BERReader reader(view);
+		return reader.next(varbind.oid) && reader.next(varbind.value);
+	}
+	
 #endif
@@ -27,9 +27,13 @@
 	    INCONSISTENT_NAME = 18
 	} ERROR_STATUS;
 	
-	struct SNMPOIDResponse
+	struct SNMPOIDResponse : public SNMPArenaAllocated
 	{
-	    ~SNMPOIDResponse(){}
+	    ~SNMPOIDResponse()
+	    {
+	        delete oid; oid = 0;
+	        delete value; value = 0;
+	    }
 	    
 	    ERROR_STATUS errorStatus;
 	    ASN_TYPE type;
@@ -37,11 +41,17 @@
 	    BER_CONTAINER* value = 0;
 	};
 	
-	typedef struct OIDResponseList
+	typedef struct OIDResponseList : public SNMPArenaAllocated
 	{
 	    ~OIDResponseList()
 	    {
-	        delete next; next = 0;
+	        // a node at a time, a full GetBulk would recurse a couple of hundred deep
+	        while(next){
+	            struct OIDResponseList* node = next;
+	            next = node->next;
+	            node->next = 0;
+	            delete node;
+	        }
 	        delete value; value = 0;
 	    }
 	    
@@ -49,7 +59,7 @@
 	    struct OIDResponseList* next = 0;
 	} ResponseList; 
 	
-	class SNMPResponse {
+	class SNMPResponse : public SNMPArenaAllocated {
 	  public:
 	    SNMPResponse(){};
 	    
@@ -66,6 +76,9 @@
 	    ERROR_STATUS errorStatus = (ERROR_STATUS)0;
 	    int errorIndex = 0;
 	    ASN_TYPE responseType = GetResponsePDU;
+	#if SNMP_V3
+	    SNMPv3Message* v3 = 0; // answering an SNMPv3 request, the PDU goes out inside a v3 message
+	#endif
 	    
 	    ResponseList* responseList = new ResponseList();
 	    ResponseList* responseConductor = responseList;
@@ -73,10 +86,15 @@
 	    bool addResponse(SNMPOIDResponse* response);
 	    bool addErrorResponse(SNMPOIDResponse* response, int index);
 	    int serialise(unsigned char* buf);
+	    int serialise(BERWriter& writer); // single pass, straight from responseList
+	    int serialise(BERWriter& writer, int varBindsLength); // the varbinds are already in writer, adds the rest
+	    static int serialisedLength(SNMPOIDResponse* response); // bytes the varbind will take up in the packet
+	    void setTooBig(); // drops the varbinds and reports tooBig, for when they won't fit in a packet
 	    
 	  private:
 	    ComplexType* response = 0;
 	    bool build();
+	    int serialiseVarBinds(ResponseList* conductor, BERWriter& writer);
 	};
 	
 	bool SNMPResponse::addResponse(SNMPOIDResponse* response){
@@ -101,6 +119,14 @@
 	    return true;
 	}
 	
+	void SNMPResponse::setTooBig(){
+	    delete responseList;
+	    responseList = new ResponseList();
+	    responseConductor = responseList;
+	    errorStatus = TOO_BIG;
+	    errorIndex = 0;
+	}
+	
 	int SNMPResponse::serialise(unsigned char* buf){
 	    if(build())
 	    {
@@ -110,6 +136,58 @@
 	    return 0;
 	}
 	
+	int SNMPResponse::serialise(BERWriter& writer){
+	    // written back to front, so the varbinds go first and the header last
+	    return serialise(writer, serialiseVarBinds(responseList, writer));
+	}
+	
+	int SNMPResponse::serialise(BERWriter& writer, int varBindsLength){
+	    int length = varBindsLength + writer.putHeader(STRUCTURE, varBindsLength);
+	    length += IntegerType(errorIndex).serialise(writer);
+	    length += IntegerType(errorStatus).serialise(writer);
+	    length += IntegerType(requestID).serialise(writer);
+	    length += writer.putHeader(responseType, length);
+	#if SNMP_V3
+	    if(v3){
+	        return v3->serialise(writer, length);
+	    }
+	#endif
+	    
+	    int communityLength = strlen(communityString);
+	    writer.putBytes((unsigned char*)communityString, communityLength);
+	    length += communityLength + writer.putHeader(STRING, communityLength);
+	    length += IntegerType(version).serialise(writer);
+	    length += writer.putHeader(STRUCTURE, length);
+	    
+	    if(writer.overflow){
+	        return 0;
+	    }
+	    return length;
+	}
+	
+	int SNMPResponse::serialisedLength(SNMPOIDResponse* response){
+	    BERWriter counter;
+	    int length = response->value->serialise(counter) + response->oid->serialise(counter);
+	    return length + counter.putHeader(STRUCTURE, length);
+	}
+	
+	int SNMPResponse::serialiseVarBinds(ResponseList* conductor, BERWriter& writer){
+	    // encoded last to first: the list is turned round for the walk and back after it, rather than
+	    // recursing once per varbind on what may be a small task stack. It ends in an empty node
+	    ResponseList* last = reverse_list(conductor);
+	    int length = 0;
+	    for(ResponseList* node = last; node; node = node->next){
+	        if(!node->value){
+	            continue;
+	        }
+	        int varBindLength = node->value->value->serialise(writer);
+	        varBindLength += node->value->oid->serialise(writer);
+	        length += varBindLength + writer.putHeader(STRUCTURE, varBindLength);
+	    }
+	    reverse_list(last);
+	    return length;
+	}
+	
 	bool SNMPResponse::build(){
 	    response = new ComplexType(STRUCTURE);
 	    response->addValueToList(new IntegerType((int)version));
@@ -129,6 +207,9 @@
 		        ComplexType* varBind = new ComplexType(STRUCTURE);
 		        varBind->addValueToList(responseConductor->value->oid);
 		        varBind->addValueToList(responseConductor->value->value);
+		        // the tree owns these now
+		        responseConductor->value->oid = 0;
+		        responseConductor->value->value = 0;
 		        varBindList->addValueToList(varBind);
 		        
 		        if(!responseConductor->next->value){
@@ -0,0 +1,190 @@
+// SetRequests as RFC 3416 4.2.5 has them: every varbind is tested before any is written, then they're
+// written in order and, if one can't be committed, the ones already written are put back. A Set with
+// several varbinds either happens as a whole or leaves everything as it was.
+
+#ifndef SNMPSet_h
+	#define SNMPSet_h
+	
+	// what an SNMPv1 manager is told instead of each error it doesn't know, RFC 2576 4.3
+	inline ERROR_STATUS snmp_v1_error(ERROR_STATUS error)
+	{
+	    switch(error){
+	        case WRONG_VALUE:
+	        case WRONG_ENCODING:
+	        case WRONG_TYPE:
+	        case WRONG_LENGTH:
+	        case INCONSISTENT_VALUE:
+	            return BAD_VALUE;
+	        case NO_ACCESS:
+	        case NOT_WRITABLE:
+	        case NO_CREATION:
+	        case INCONSISTENT_NAME:
+	        case AUTHORIZATION_ERROR:
+	            return NO_SUCH_NAME;
+	        case RESOURCE_UNAVAILABLE:
+	        case COMMIT_FAILED:
+	        case UNDO_FAILED:
+	            return GEN_ERR;
+	        default:
+	            return error;
+	    }
+	}
+	
+	// One varbind of a Set, from when it's tested until the response goes. Everything the write needs is
+	// copied out of the handler, a table or static MIB cell is reused for the next varbind's lookup
+	typedef struct SNMPSetOperationStruct
+	{
+	    ValueCallback* callback;            // for its commit hook, 0 for a cell
+	    ASN_TYPE type;
+	    bool isFloat;
+	    void* target;                       // the int, the float, or the string's buffer
+	    long number;                        // an INTEGER or TIMESTAMP's new value, tenths for a float
+	    const unsigned char* bytes;         // a STRING's, in the request packet
+	    unsigned short length;
+	    union {
+	        int integer;
+	        float floating;
+	        char* string;                   // a copy of what the buffer held, out of the request arena
+	    } old;
+	    
+	    // the checks that don't need anything written: whether the handler exists and can be set, and
+	    // whether the value's type, length and range suit it. NO_ERROR if the write may go ahead
+	    ERROR_STATUS test(ValueCallback* handler, VarBind& varbind, bool writable)
+	    {
+	        callback = 0;
+	        old.string = 0;
+	        if(!writable){
+	            Snmp_Serial_println(F("[DEBUG SNMP] READONLY COMMUNITY USED"));
+	            return NO_ACCESS;
+	        }
+	        if(!handler){
+	            Snmp_Serial_println(F("[DEBUG SNMP] OID NOT FOUND"));
+	            return NO_CREATION;
+	        }
+	        if(!handler->isSettable){
+	            Snmp_Serial_println(F("[DEBUG SNMP] OID NOT SETTABLE"));
+	            return NOT_WRITABLE;
+	        }
+	        if(handler->type != varbind.type()){
+	            Snmp_Serial_println(F("[DEBUG SNMP] VALUE-TYPE DOES NOT MATCH"));
+	            return WRONG_TYPE;
+	        }
+	        
+	        type = handler->type;
+	        isFloat = false;
+	        number = 0;
+	        bytes = varbind.value.value;
+	        length = varbind.value.length;
+	        switch(type){
+	            case INTEGER:
+	                isFloat = ((IntegerCallback*)handler)->isFloat;
+	                // int is 16 bits on AVR
+	                if(!BERReader::readInteger(varbind.value, number) || (!isFloat && (long)(int)number != number)){
+	                    return WRONG_VALUE;
+	                }
+	                target = ((IntegerCallback*)handler)->value;
+	                break;
+	            case TIMESTAMP:
+	                {
+	                    uint64_t ticks;
+	                    if(!BERReader::readUnsigned(varbind.value, ticks) || (uint64_t)(unsigned int)ticks != ticks){
+	                        return WRONG_VALUE;
+	                    }
+	                    number = (long)ticks;
+	                    target = ((TimestampCallback*)handler)->value;
+	                }
+	                break;
+	            case STRING:
+	                {
+	                    StringCallback* string = (StringCallback*)handler;
+	                    target = *string->value;
+	                    // without the buffer's size, the string it holds now is all that's known to fit
+	                    size_t capacity = string->size ? string->size : (target ? strlen((char*)target) + 1 : 0);
+	                    if(string->length >= 0 || length >= capacity){
+	                        Snmp_Serial_println(F("[DEBUG SNMP] STRING TOO LONG"));
+	                        return WRONG_LENGTH;
+	                    }
+	                }
+	                break;
+	            default:
+	                return NOT_WRITABLE;
+	        }
+	        
+	        if(!handler->isCell){
+	            callback = handler;
+	        }
+	        if(handler->validator){
+	            return handler->validator(handler, number, bytes, length);
+	        }
+	        return NO_ERROR;
+	    }
+	    
+	    // writes the new value, keeping the old one for undo()
+	    void apply()
+	    {
+	        switch(type){
+	            case INTEGER:
+	                if(isFloat){
+	                    old.floating = *(float*)target;
+	                    *(float*)target = number / 10.0f;
+	                } else {
+	                    old.integer = *(int*)target;
+	                    *(int*)target = number;
+	                }
+	                break;
+	            case TIMESTAMP:
+	                old.integer = *(int*)target;
+	                *(int*)target = (int)(unsigned int)number;
+	                break;
+	            case STRING:
+	                {
+	                    size_t previous = strlen((char*)target) + 1;
+	                    old.string = (char*)SNMPArenaAllocated::operator new(previous);
+	                    memcpy(old.string, target, previous);
+	                    // the value is a view into the packet, it isn't null terminated there
+	                    memcpy(target, bytes, length);
+	                    ((char*)target)[length] = 0;
+	                }
+	                break;
+	            default:
+	                break;
+	        }
+	    }
+	    
+	    void undo()
+	    {
+	        switch(type){
+	            case INTEGER:
+	                if(isFloat){
+	                    *(float*)target = old.floating;
+	                } else {
+	                    *(int*)target = old.integer;
+	                }
+	                break;
+	            case TIMESTAMP:
+	                *(int*)target = old.integer;
+	                break;
+	            case STRING:
+	                strcpy((char*)target, old.string);
+	                break;
+	            default:
+	                break;
+	        }
+	    }
+	    
+	    // the handler's commit hook, true if there isn't one
+	    bool commit()
+	    {
+	        return !callback || !callback->commit || callback->commit(callback);
+	    }
+	    
+	    void release()
+	    {
+	        if(type == STRING && old.string){
+	            SNMPArenaAllocated::operator delete(old.string);
+	            old.string = 0;
+	        }
+	    }
+	} SNMPSetOperation;
+	
+#endif
@@ -0,0 +1,339 @@
+// A MIB fixed when the firmware is built: a constexpr array of SNMPStaticEntry, in OID order, handed to
+// SNMPAgent::setStaticMIB(). The entries and their OIDs are constants in flash, so there's nothing to
+// register at boot and no handler index in RAM. The agent looks them up by binary search straight out of
+// the array, next to whatever handlers are added at runtime.
+//
+//   static constexpr SNMPStaticEntry mib[] SNMP_STATIC_MIB_SECTION = {
+//       SNMPStaticEntry::integer<1,3,6,1,4,1,5,0>(&changingNumber),
+//       SNMPStaticEntry::integer<1,3,6,1,4,1,5,1>(&settableNumber, true),
+//       SNMPStaticEntry::gauge<1,3,6,1,4,1,5,2>(freeHeap),
+//   };
+//   static_assert(SNMPStaticEntry::sorted(mib), "the static MIB has to be in OID order");
+//   snmp.setStaticMIB(mib);
+
+#ifndef SNMPStatic_h
+	#define SNMPStatic_h
+	
+	#ifndef SNMP_STATIC_PROGMEM
+		#if defined(__AVR__) || defined(ESP8266)
+			#define SNMP_STATIC_PROGMEM 1  // constants are copied into RAM here unless they're put in PROGMEM, and have to be read back with memcpy_P
+		#else
+			#define SNMP_STATIC_PROGMEM 0  // constants stay in flash (ESP32) or rodata as they are
+		#endif
+	#endif
+	
+	#if SNMP_STATIC_PROGMEM
+		#define SNMP_STATIC_MIB_SECTION PROGMEM
+	#else
+		#define SNMP_STATIC_MIB_SECTION
+	#endif
+	
+	#define SNMP_STATIC_SETTABLE    1
+	#define SNMP_STATIC_GETTER      2   // the value comes from calling a function, read only
+	#define SNMP_STATIC_FLOAT       4   // an INTEGER that's a float times 10, like addFloatHandler
+	#define SNMP_STATIC_BUFFER      8   // a STRING that's a char array of size bytes, rather than a char* to follow
+	
+	// an OID's sub-identifiers as a constant, one array per OID however many entries use it
+	template <uint32_t... subids>
+	struct SNMPStaticOID {
+	    static constexpr uint32_t value[sizeof...(subids)] SNMP_STATIC_MIB_SECTION = {subids...};
+	};
+	
+	template <uint32_t... subids>
+	constexpr uint32_t SNMPStaticOID<subids...>::value[sizeof...(subids)];
+	
+	struct SNMPStaticEntry {
+	    const uint32_t* oid;
+	    uint8_t oidLength;
+	    uint8_t flags;
+	    uint16_t size;                      // SNMP_STATIC_BUFFER strings
+	    ASN_TYPE type;
+	    union {
+	        const void* variable;           // what the handler would point at: int*, float*, uint32_t*, uint64_t*, char** or the char array
+	        int (*integerGetter)();
+	        uint32_t (*unsignedGetter)();
+	        uint64_t (*counter64Getter)();
+	        const char* (*stringGetter)();
+	    };
+	
+	    constexpr SNMPStaticEntry(const uint32_t* oid, uint8_t oidLength, ASN_TYPE type, uint8_t flags, uint16_t size, const void* variable)
+	        : oid(oid), oidLength(oidLength), flags(flags), size(size), type(type), variable(variable){};
+	    constexpr SNMPStaticEntry(const uint32_t* oid, uint8_t oidLength, ASN_TYPE type, int (*getter)())
+	        : oid(oid), oidLength(oidLength), flags(SNMP_STATIC_GETTER), size(0), type(type), integerGetter(getter){};
+	    constexpr SNMPStaticEntry(const uint32_t* oid, uint8_t oidLength, ASN_TYPE type, uint32_t (*getter)())
+	        : oid(oid), oidLength(oidLength), flags(SNMP_STATIC_GETTER), size(0), type(type), unsignedGetter(getter){};
+	    constexpr SNMPStaticEntry(const uint32_t* oid, uint8_t oidLength, ASN_TYPE type, uint64_t (*getter)())
+	        : oid(oid), oidLength(oidLength), flags(SNMP_STATIC_GETTER), size(0), type(type), counter64Getter(getter){};
+	    constexpr SNMPStaticEntry(const uint32_t* oid, uint8_t oidLength, ASN_TYPE type, const char* (*getter)())
+	        : oid(oid), oidLength(oidLength), flags(SNMP_STATIC_GETTER), size(0), type(type), stringGetter(getter){};
+	
+	    // one of these for each kind of handler, the OID goes in the template arguments
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry integer(int* value, bool settable = false)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), INTEGER, settable ? SNMP_STATIC_SETTABLE : 0, 0, value);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry integer(int (*getter)())
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), INTEGER, getter);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry floating(float* value, bool settable = false)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), INTEGER, SNMP_STATIC_FLOAT | (settable ? SNMP_STATIC_SETTABLE : 0), 0, value);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry timestamp(int* value, bool settable = false)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), TIMESTAMP, settable ? SNMP_STATIC_SETTABLE : 0, 0, value);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry timestamp(int (*getter)())
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), TIMESTAMP, getter);
+	    }
+	    // a char* the sketch may point somewhere else. Settable only if it points at a buffer that's big enough
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry string(char** value, bool settable = false)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), STRING, settable ? SNMP_STATIC_SETTABLE : 0, 0, value);
+	    }
+	    // a char array, a Set longer than it will hold is refused
+	    template <uint32_t... subids, size_t N>
+	    static constexpr SNMPStaticEntry string(char (&buffer)[N], bool settable = false)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), STRING, SNMP_STATIC_BUFFER | (settable ? SNMP_STATIC_SETTABLE : 0), N, buffer);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry string(const char* (*getter)())
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), STRING, getter);
+	    }
+	    // the OID value as a string, ".1.3.6.1.4.1.5"
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry objectID(const char* value)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), OID, 0, 0, value);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry counter32(uint32_t* value)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), COUNTER32, 0, 0, value);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry counter32(uint32_t (*getter)())
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), COUNTER32, getter);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry gauge(uint32_t* value)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), GUAGE32, 0, 0, value);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry gauge(uint32_t (*getter)())
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), GUAGE32, getter);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry counter64(uint64_t* value)
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), COUNTER64, 0, 0, value);
+	    }
+	    template <uint32_t... subids>
+	    static constexpr SNMPStaticEntry counter64(uint64_t (*getter)())
+	    {
+	        return SNMPStaticEntry(SNMPStaticOID<subids...>::value, sizeof...(subids), COUNTER64, getter);
+	    }
+	
+	    // whether the entries are in strictly increasing OID order, for a static_assert next to the array.
+	    // Halves the array each step, so the compiler's constexpr depth limit isn't a limit on its size
+	    template <size_t N>
+	    static constexpr bool sorted(const SNMPStaticEntry (&entries)[N])
+	    {
+	        return sortedBetween(entries, 0, N);
+	    }
+	    static constexpr bool sortedBetween(const SNMPStaticEntry* entries, size_t from, size_t to)
+	    {
+	        return to - from < 2 || (sortedBetween(entries, from, (from + to) / 2) && sortedBetween(entries, (from + to) / 2, to)
+	            && before(entries[(from + to) / 2 - 1].oid, entries[(from + to) / 2 - 1].oidLength, entries[(from + to) / 2].oid, entries[(from + to) / 2].oidLength, 0));
+	    }
+	    static constexpr bool before(const uint32_t* one, int oneLength, const uint32_t* two, int twoLength, int i)
+	    {
+	        return i == oneLength ? i < twoLength : (i == twoLength ? false : (one[i] != two[i] ? one[i] < two[i] : before(one, oneLength, two, twoLength, i + 1)));
+	    }
+	};
+	
+	// What the agent looks the static MIB up with. An entry is handed out as one of a few handlers kept
+	// here, filled in from the entry, so like a table's cells it's only good until the next lookup
+	class SNMPStaticMIB {
+	  public:
+	    SNMPStaticMIB()
+	    {
+	        ValueCallback* cells[] = {&_integerCell, &_timestampCell, &_stringCell, &_oidCell, &_counter32Cell, &_guageCell, &_counter64Cell};
+	        for(unsigned i = 0; i < sizeof(cells) / sizeof(cells[0]); i++){
+	            cells[i]->isCell = true;
+	            cells[i]->overwritePrefix = true;
+	            cells[i]->oidSubids = _cellOID;
+	        }
+	    };
+	
+	    const SNMPStaticEntry* entries = 0;
+	    uint16_t count = 0;
+	
+	    ValueCallback* find(const uint32_t* oid, int oidLength, bool next);
+	    // find() in two steps, so the entry can be compared with something else before its getter runs.
+	    // locate() gives the entry's index, -1 if there isn't one
+	    int locate(const uint32_t* oid, int oidLength, bool next);
+	    int compare(uint16_t index, const uint32_t* oid, int oidLength);
+	    ValueCallback* cell(uint16_t index);
+	
+	  private:
+	    void load(uint16_t index, SNMPStaticEntry* entry);
+	
+	    uint32_t _cellOID[MAX_OID_SUBIDENTIFIERS];
+	    IntegerCallback _integerCell;
+	    TimestampCallback _timestampCell;
+	    StringCallback _stringCell;
+	    OIDCallback _oidCell;
+	    Counter32Callback _counter32Cell;
+	    Guage32Callback _guageCell;
+	    Counter64Callback _counter64Cell;
+	    int _integer;
+	    char* _string;
+	    uint32_t _unsigned32;
+	    uint64_t _unsigned64;
+	};
+	
+	void SNMPStaticMIB::load(uint16_t index, SNMPStaticEntry* entry)
+	{
+	#if SNMP_STATIC_PROGMEM
+	    memcpy_P(entry, &entries[index], sizeof(SNMPStaticEntry));
+	#else
+	    memcpy(entry, &entries[index], sizeof(SNMPStaticEntry));
+	#endif
+	}
+	
+	int SNMPStaticMIB::compare(uint16_t index, const uint32_t* oid, int oidLength)
+	{
+	    SNMPStaticEntry entry(0, 0, NULLTYPE, 0, 0, (const void*)0);
+	    load(index, &entry);
+	#if SNMP_STATIC_PROGMEM
+	    uint32_t subids[MAX_OID_SUBIDENTIFIERS];
+	    int length = MIN(entry.oidLength, MAX_OID_SUBIDENTIFIERS);
+	    memcpy_P(subids, entry.oid, length * sizeof(uint32_t));
+	    return oid_compare(subids, length, oid, oidLength);
+	#else
+	    return oid_compare(entry.oid, entry.oidLength, oid, oidLength);
+	#endif
+	}
+	
+	ValueCallback* SNMPStaticMIB::find(const uint32_t* oid, int oidLength, bool next)
+	{
+	    int index = locate(oid, oidLength, next);
+	    return index < 0 ? 0 : cell(index);
+	}
+	
+	int SNMPStaticMIB::locate(const uint32_t* oid, int oidLength, bool next)
+	{
+	    // the first entry at oid, or for a getnext the first one after it
+	    int low = 0;
+	    int high = count;
+	    while(low < high){
+	        int mid = (low + high) / 2;
+	        int comparison = compare(mid, oid, oidLength);
+	        if(comparison < 0 || (next && comparison == 0)){
+	            low = mid + 1;
+	        } else {
+	            high = mid;
+	        }
+	    }
+	    if(low == count || (!next && compare(low, oid, oidLength) != 0)){
+	        return -1;
+	    }
+	    return low;
+	}
+	
+	ValueCallback* SNMPStaticMIB::cell(uint16_t index)
+	{
+	    SNMPStaticEntry entry(0, 0, NULLTYPE, 0, 0, (const void*)0);
+	    load(index, &entry);
+	    bool getter = entry.flags & SNMP_STATIC_GETTER;
+	    ValueCallback* cell;
+	    switch(entry.type){
+	        case INTEGER:
+	            if(getter){
+	                _integer = entry.integerGetter();
+	                _integerCell.value = &_integer;
+	            } else {
+	                _integerCell.value = (int*)entry.variable;
+	            }
+	            _integerCell.isFloat = entry.flags & SNMP_STATIC_FLOAT;
+	            cell = &_integerCell;
+	            break;
+	        case TIMESTAMP:
+	            if(getter){
+	                _integer = entry.integerGetter();
+	                _timestampCell.value = &_integer;
+	            } else {
+	                _timestampCell.value = (int*)entry.variable;
+	            }
+	            cell = &_timestampCell;
+	            break;
+	        case STRING:
+	            if(getter || (entry.flags & SNMP_STATIC_BUFFER)){
+	                _string = getter ? (char*)entry.stringGetter() : (char*)entry.variable;
+	                _stringCell.value = &_string;
+	            } else {
+	                _stringCell.value = (char**)entry.variable;
+	            }
+	            _stringCell.transient = getter; // a getter is free to hand back the same buffer every time
+	            _stringCell.size = entry.size;
+	            cell = &_stringCell;
+	            break;
+	        case OID:
+	            _oidCell.value = (char*)entry.variable;
+	            cell = &_oidCell;
+	            break;
+	        case COUNTER32:
+	            if(getter){
+	                _unsigned32 = entry.unsignedGetter();
+	                _counter32Cell.value = &_unsigned32;
+	            } else {
+	                _counter32Cell.value = (uint32_t*)entry.variable;
+	            }
+	            cell = &_counter32Cell;
+	            break;
+	        case GUAGE32:
+	            if(getter){
+	                _unsigned32 = entry.unsignedGetter();
+	                _guageCell.value = &_unsigned32;
+	            } else {
+	                _guageCell.value = (uint32_t*)entry.variable;
+	            }
+	            cell = &_guageCell;
+	            break;
+	        case COUNTER64:
+	            if(getter){
+	                _unsigned64 = entry.counter64Getter();
+	                _counter64Cell.value = &_unsigned64;
+	            } else {
+	                _counter64Cell.value = (uint64_t*)entry.variable;
+	            }
+	            cell = &_counter64Cell;
+	            break;
+	        default:
+	            return 0;
+	    }
+	    cell->isSettable = (entry.flags & SNMP_STATIC_SETTABLE) && !getter;
+	    cell->oidLength = MIN(entry.oidLength, MAX_OID_SUBIDENTIFIERS);
+	#if SNMP_STATIC_PROGMEM
+	    memcpy_P(_cellOID, entry.oid, cell->oidLength * sizeof(uint32_t));
+	#else
+	    memcpy(_cellOID, entry.oid, cell->oidLength * sizeof(uint32_t));
+	#endif
+	    return cell;
+	}
+	
+#endif
@@ -0,0 +1,321 @@
+// A conceptual table (ifTable and the like) registered as one handler under its entry OID.
+// Cells are entry.column.row: the rows come from a function, each column's cells from a getter
+// that's given the row, and nothing is read until a request lands on that cell. Only single
+// sub-identifier row indices are supported, and rows start at 1 as ifIndex does.
+
+#ifndef SNMPTable_h
+	#define SNMPTable_h
+	
+	typedef struct SNMPTableColumnStruct
+	{
+	    uint32_t number;
+	    ASN_TYPE type;
+	    bool bytes;                         // a STRING column of bytes with a length rather than a null terminated string
+	    union {
+	        int (*integer)(uint32_t row);
+	        const char* (*string)(uint32_t row);
+	        const unsigned char* (*bytes)(uint32_t row, unsigned short* length);
+	        uint32_t (*unsigned32)(uint32_t row);
+	        uint64_t (*unsigned64)(uint32_t row);
+	    } get;
+	} SNMPTableColumn;
+	
+	class TableCallback: public ValueCallback {
+	  public:
+	    // rows 1 to rowCount()
+	    TableCallback(uint32_t (*rowCount)()): ValueCallback(STRUCTURE), rowCount(rowCount)
+	    {
+	        initCells();
+	    };
+	    // rows in any order of index, nextRow(after) gives the first row above after, 0 when there are no more
+	    TableCallback(uint32_t (*nextRow)(uint32_t after)): ValueCallback(STRUCTURE), nextRow(nextRow)
+	    {
+	        initCells();
+	    };
+	    ~TableCallback()
+	    {
+	        free(columns);
+	    };
+	
+	    uint32_t (*rowCount)() = 0;
+	    uint32_t (*nextRow)(uint32_t after) = 0;
+	    SNMPTableColumn* columns = 0;
+	    uint8_t columnCount = 0;
+	
+	    bool addIntegerColumn(uint32_t column, int (*getter)(uint32_t row));
+	    bool addStringColumn(uint32_t column, const char* (*getter)(uint32_t row));
+	    bool addBytesColumn(uint32_t column, const unsigned char* (*getter)(uint32_t row, unsigned short* length));
+	    bool addTimestampColumn(uint32_t column, uint32_t (*getter)(uint32_t row));
+	    bool addCounter32Column(uint32_t column, uint32_t (*getter)(uint32_t row));
+	    bool addGuageColumn(uint32_t column, uint32_t (*getter)(uint32_t row));
+	    bool addCounter64Column(uint32_t column, uint64_t (*getter)(uint32_t row));
+	
+	    // the cell at oid, or for a getnext the first one after it. The handler handed back is only
+	    // good until the next call, it's reused for every cell
+	    ValueCallback* findCell(const uint32_t* oid, int oidLength, bool next);
+	
+	  protected:
+	    // for a table that keeps its own rows, overriding rowAfter() and readColumn() rather than giving getters
+	    TableCallback(): ValueCallback(STRUCTURE)
+	    {
+	        initCells();
+	    };
+	    bool addColumn(SNMPTableColumn column);
+	    virtual uint32_t rowAfter(uint32_t row);
+	    // the cell's value into _integer, _string and _stringLength, _unsigned32 or _unsigned64 as its type needs
+	    virtual void readColumn(SNMPTableColumn* column, uint32_t row);
+	
+	    int _integer;
+	    char* _string;
+	    int _stringLength;
+	    uint32_t _unsigned32;
+	    uint64_t _unsigned64;
+	
+	  private:
+	    void initCells();
+	    ValueCallback* readCell(SNMPTableColumn* column, uint32_t row);
+	
+	    uint32_t _cellOID[MAX_OID_SUBIDENTIFIERS];
+	    IntegerCallback _integerCell;
+	    TimestampCallback _timestampCell;
+	    StringCallback _stringCell;
+	    Counter32Callback _counter32Cell;
+	    Guage32Callback _guageCell;
+	    Counter64Callback _counter64Cell;
+	};
+	
+	void TableCallback::initCells()
+	{
+	    isTable = true;
+	    _integerCell.isCell = true;
+	    _timestampCell.isCell = true;
+	    _stringCell.isCell = true;
+	    _stringCell.transient = true; // a column getter is free to hand back the same buffer for every row
+	    _counter32Cell.isCell = true;
+	    _guageCell.isCell = true;
+	    _counter64Cell.isCell = true;
+	}
+	
+	bool TableCallback::addIntegerColumn(uint32_t column, int (*getter)(uint32_t row))
+	{
+	    SNMPTableColumn entry;
+	    entry.number = column;
+	    entry.type = INTEGER;
+	    entry.bytes = false;
+	    entry.get.integer = getter;
+	    return addColumn(entry);
+	}
+	
+	bool TableCallback::addStringColumn(uint32_t column, const char* (*getter)(uint32_t row))
+	{
+	    SNMPTableColumn entry;
+	    entry.number = column;
+	    entry.type = STRING;
+	    entry.bytes = false;
+	    entry.get.string = getter;
+	    return addColumn(entry);
+	}
+	
+	bool TableCallback::addBytesColumn(uint32_t column, const unsigned char* (*getter)(uint32_t row, unsigned short* length))
+	{
+	    SNMPTableColumn entry;
+	    entry.number = column;
+	    entry.type = STRING;
+	    entry.bytes = true;
+	    entry.get.bytes = getter;
+	    return addColumn(entry);
+	}
+	
+	bool TableCallback::addTimestampColumn(uint32_t column, uint32_t (*getter)(uint32_t row))
+	{
+	    SNMPTableColumn entry;
+	    entry.number = column;
+	    entry.type = TIMESTAMP;
+	    entry.bytes = false;
+	    entry.get.unsigned32 = getter;
+	    return addColumn(entry);
+	}
+	
+	bool TableCallback::addCounter32Column(uint32_t column, uint32_t (*getter)(uint32_t row))
+	{
+	    SNMPTableColumn entry;
+	    entry.number = column;
+	    entry.type = COUNTER32;
+	    entry.bytes = false;
+	    entry.get.unsigned32 = getter;
+	    return addColumn(entry);
+	}
+	
+	bool TableCallback::addGuageColumn(uint32_t column, uint32_t (*getter)(uint32_t row))
+	{
+	    SNMPTableColumn entry;
+	    entry.number = column;
+	    entry.type = GUAGE32;
+	    entry.bytes = false;
+	    entry.get.unsigned32 = getter;
+	    return addColumn(entry);
+	}
+	
+	bool TableCallback::addCounter64Column(uint32_t column, uint64_t (*getter)(uint32_t row))
+	{
+	    SNMPTableColumn entry;
+	    entry.number = column;
+	    entry.type = COUNTER64;
+	    entry.bytes = false;
+	    entry.get.unsigned64 = getter;
+	    return addColumn(entry);
+	}
+	
+	bool TableCallback::addColumn(SNMPTableColumn column)
+	{
+	    // kept in column order, that's the order a walk visits them in
+	    int index = 0;
+	    while(index < columnCount && columns[index].number < column.number){
+	        index++;
+	    }
+	    if(index < columnCount && columns[index].number == column.number){
+	        columns[index] = column;
+	        return true;
+	    }
+	    if(columnCount == 255){
+	        return false;
+	    }
+	    SNMPTableColumn* grown = (SNMPTableColumn*)realloc(columns, (columnCount + 1) * sizeof(SNMPTableColumn));
+	    if(!grown){
+	        return false;
+	    }
+	    columns = grown;
+	    memmove(&columns[index + 1], &columns[index], (columnCount - index) * sizeof(SNMPTableColumn));
+	    columns[index] = column;
+	    columnCount++;
+	    return true;
+	}
+	
+	uint32_t TableCallback::rowAfter(uint32_t row)
+	{
+	    if(nextRow){
+	        return nextRow(row);
+	    }
+	    return row < rowCount() ? row + 1 : 0;
+	}
+	
+	ValueCallback* TableCallback::findCell(const uint32_t* oid, int oidLength, bool next)
+	{
+	    if(this->oidLength > MAX_OID_SUBIDENTIFIERS - 2){
+	        return 0;
+	    }
+	
+	    // whatever follows the entry OID: column, then row
+	    const uint32_t* suffix = 0;
+	    int suffixLength = 0;
+	    if(oid_starts_with(oid, oidLength, oidSubids, this->oidLength)){
+	        suffix = oid + this->oidLength;
+	        suffixLength = oidLength - this->oidLength;
+	    }
+	
+	    if(!next){
+	        if(suffixLength != 2 || suffix[1] == 0 || rowAfter(suffix[1] - 1) != suffix[1]){
+	            return 0;
+	        }
+	        for(int i = 0; i < columnCount; i++){
+	            if(columns[i].number == suffix[0]){
+	                return readCell(&columns[i], suffix[1]);
+	            }
+	        }
+	        return 0;
+	    }
+	
+	    // getnext: the next row down the same column, or the top of the next column along
+	    int column = 0;
+	    uint32_t after = 0;
+	    if(suffixLength > 0){
+	        while(column < columnCount && columns[column].number < suffix[0]){
+	            column++;
+	        }
+	        if(column < columnCount && columns[column].number == suffix[0] && suffixLength > 1){
+	            after = suffix[1];
+	        }
+	    }
+	    for(; column < columnCount; column++){
+	        uint32_t row = rowAfter(after);
+	        if(row){
+	            return readCell(&columns[column], row);
+	        }
+	        after = 0;
+	    }
+	    return 0;
+	}
+	
+	void TableCallback::readColumn(SNMPTableColumn* column, uint32_t row)
+	{
+	    switch(column->type){
+	        case INTEGER:
+	            _integer = column->get.integer(row);
+	            break;
+	        case STRING:
+	            if(column->bytes){
+	                unsigned short length = 0;
+	                _string = (char*)column->get.bytes(row, &length);
+	                _stringLength = length;
+	            } else {
+	                _string = (char*)column->get.string(row);
+	                _stringLength = -1;
+	            }
+	            break;
+	        case TIMESTAMP:
+	            _integer = column->get.unsigned32(row);
+	            break;
+	        case COUNTER32:
+	        case GUAGE32:
+	            _unsigned32 = column->get.unsigned32(row);
+	            break;
+	        case COUNTER64:
+	            _unsigned64 = column->get.unsigned64(row);
+	            break;
+	        default:
+	            break;
+	    }
+	}
+	
+	ValueCallback* TableCallback::readCell(SNMPTableColumn* column, uint32_t row)
+	{
+	    ValueCallback* cell;
+	    readColumn(column, row);
+	    switch(column->type){
+	        case INTEGER:
+	            _integerCell.value = &_integer;
+	            cell = &_integerCell;
+	            break;
+	        case STRING:
+	            _stringCell.length = _stringLength;
+	            _stringCell.value = &_string;
+	            cell = &_stringCell;
+	            break;
+	        case TIMESTAMP:
+	            _timestampCell.value = &_integer;
+	            cell = &_timestampCell;
+	            break;
+	        case COUNTER32:
+	            _counter32Cell.value = &_unsigned32;
+	            cell = &_counter32Cell;
+	            break;
+	        case GUAGE32:
+	            _guageCell.value = &_unsigned32;
+	            cell = &_guageCell;
+	            break;
+	        case COUNTER64:
+	            _counter64Cell.value = &_unsigned64;
+	            cell = &_counter64Cell;
+	            break;
+	        default:
+	            return 0;
+	    }
+	    memcpy(_cellOID, oidSubids, this->oidLength * sizeof(uint32_t));
+	    _cellOID[this->oidLength] = column->number;
+	    _cellOID[this->oidLength + 1] = row;
+	    cell->oidSubids = _cellOID;
+	    cell->oidLength = this->oidLength + 2;
+	    return cell;
+	}
+
+#endif
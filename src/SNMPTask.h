@@ -0,0 +1,208 @@
+// What the agent needs to answer requests from a task of its own (see SNMPAgent::useTask): a
+// task that can be started and stopped, and a lock for everything the task shares with the sketch.
+// FreeRTOS on the ESP32, std::thread on a POSIX host. Elsewhere there are no tasks, the lock does
+// nothing and the agent has to be driven from loop().
+
+#ifndef SNMPTask_h
+	#define SNMPTask_h
+	
+	#ifndef SNMP_TASK_STACK
+		#define SNMP_TASK_STACK 6144  // bytes on the ESP32, the request and response buffers are in the agent rather than on this stack
+	#endif
+	
+	#ifndef SNMP_TASK_PRIORITY
+		#define SNMP_TASK_PRIORITY 1  // the same as the Arduino loop task
+	#endif
+	
+	#ifndef SNMP_TASK_CORE
+		#define SNMP_TASK_CORE 0  // off the core loop() runs on. Ignored on the host
+	#endif
+	
+	#ifndef SNMP_TASK_BURST
+		#define SNMP_TASK_BURST 8  // requests handled per turn of the task before it lets go of the lock
+	#endif
+	
+	#ifndef SNMP_TASK_IDLE_MS
+		#define SNMP_TASK_IDLE_MS 1  // how long the task sleeps when nothing is queued, the Arduino UDP class can't be waited on
+	#endif
+	
+	#ifndef SNMP_TASK_WAIT_MS
+		#define SNMP_TASK_WAIT_MS 20  // longest a wait function given to setTaskWait() is asked to block, stop() takes up to this long
+	#endif
+	
+	#if defined(ESP32)
+		#include <freertos/FreeRTOS.h>
+		#include <freertos/task.h>
+		#include <freertos/semphr.h>
+		#define SNMP_HAS_TASKS 1
+	#elif !defined(ARDUINO)
+		#include <mutex>
+		#include <thread>
+		#include <atomic>
+		#define SNMP_HAS_TASKS 1
+	#else
+		#define SNMP_HAS_TASKS 0
+	#endif
+	
+	// Recursive, so the agent can take it in a method that calls another one that takes it too
+	class SNMPMutex {
+		public:
+		#if defined(ESP32)
+		    SNMPMutex(): _handle(xSemaphoreCreateRecursiveMutex()){};
+		    ~SNMPMutex()
+		    {
+		        vSemaphoreDelete(_handle);
+		    };
+		    void lock()
+		    {
+		        xSemaphoreTakeRecursive(_handle, portMAX_DELAY);
+		    }
+		    void unlock()
+		    {
+		        xSemaphoreGiveRecursive(_handle);
+		    }
+	
+		private:
+		    SemaphoreHandle_t _handle;
+		#elif SNMP_HAS_TASKS
+		    void lock()
+		    {
+		        _mutex.lock();
+		    }
+		    void unlock()
+		    {
+		        _mutex.unlock();
+		    }
+	
+		private:
+		    std::recursive_mutex _mutex;
+		#else
+		    void lock(){}
+		    void unlock(){}
+		#endif
+	};
+	
+	// Holds an SNMPMutex for as long as it's in scope
+	class SNMPMutexGuard {
+		public:
+		    SNMPMutexGuard(SNMPMutex& mutex): _mutex(mutex)
+		    {
+		        _mutex.lock();
+		    };
+		    ~SNMPMutexGuard()
+		    {
+		        _mutex.unlock();
+		    };
+	
+		private:
+		    SNMPMutex& _mutex;
+	};
+	
+	// One task running body(argument) until stop() is called. body is expected to keep checking
+	// stopping() and return once it's set.
+	class SNMPTask {
+		public:
+		    SNMPTask(){};
+		    ~SNMPTask()
+		    {
+		        stop();
+		    };
+	
+		    bool start(void (*body)(void*), void* argument, const char* name, uint32_t stackSize, unsigned priority, int core);
+		    void stop();
+	
+		    bool running()
+		    {
+		        return _running;
+		    }
+	
+		    bool stopping()
+		    {
+		        return _stopping;
+		    }
+	
+		    static void sleep(unsigned long ms);
+	
+		private:
+		    void (*_body)(void*) = 0;
+		    void* _argument = 0;
+		    static void run(void* task);
+		#if defined(ESP32)
+		    TaskHandle_t _handle = 0;
+		    volatile bool _running = false;
+		    volatile bool _stopping = false;
+		#elif SNMP_HAS_TASKS
+		    std::thread _thread;
+		    std::atomic<bool> _running{false};
+		    std::atomic<bool> _stopping{false};
+		#else
+		    bool _running = false;
+		    bool _stopping = false;
+		#endif
+	};
+	
+	void SNMPTask::run(void* task)
+	{
+	    SNMPTask* self = (SNMPTask*)task;
+	    self->_body(self->_argument);
+	    self->_running = false;
+	#if defined(ESP32)
+	    vTaskDelete(NULL); // a FreeRTOS task mustn't return
+	#endif
+	}
+	
+	bool SNMPTask::start(void (*body)(void*), void* argument, const char* name, uint32_t stackSize, unsigned priority, int core)
+	{
+	    if(_running){
+	        return false;
+	    }
+	#if !defined(ESP32)
+	    (void)name; (void)stackSize; (void)priority; (void)core; // only a FreeRTOS task has these
+	#endif
+	    _body = body;
+	    _argument = argument;
+	    _stopping = false;
+	    _running = true;
+	#if defined(ESP32)
+	    if(xTaskCreatePinnedToCore(run, name, stackSize, this, priority, &_handle, core) != pdPASS){
+	        _running = false;
+	        return false;
+	    }
+	    return true;
+	#elif SNMP_HAS_TASKS
+	    if(_thread.joinable()){
+	        _thread.join(); // finished by itself, but never joined
+	    }
+	    _thread = std::thread(run, this);
+	    return true;
+	#else
+	    _running = false;
+	    return false;
+	#endif
+	}
+	
+	void SNMPTask::stop()
+	{
+	    _stopping = true;
+	#if defined(ESP32)
+	    while(_running){
+	        vTaskDelay(1);
+	    }
+	    _handle = 0;
+	#elif SNMP_HAS_TASKS
+	    if(_thread.joinable()){
+	        _thread.join();
+	    }
+	#endif
+	}
+	
+	void SNMPTask::sleep(unsigned long ms)
+	{
+	#if defined(ESP32)
+	    vTaskDelay(ms / portTICK_PERIOD_MS ? ms / portTICK_PERIOD_MS : 1);
+	#else
+	    delay(ms);
+	#endif
+	}
+	
+#endif
@@ -0,0 +1,188 @@
+// Pollers tend to send the very same Get every interval. The first time one is answered the agent
+// remembers which handler each varbind resolved to; after that an identical request (same version,
+// community and varbind list, whatever its request-id) skips the OID decoding and handler lookups.
+// The OIDs are copied straight out of the request and only the values are encoded afresh.
+// A request only gets a template the second time it's seen, so a walk or a stream of one-off
+// Gets doesn't keep pushing the pollers' templates out.
+
+#ifndef SNMPTemplate_h
+	#define SNMPTemplate_h
+	
+	#ifndef SNMP_TEMPLATE_COUNT
+		#if defined(ESP32) || !defined(ARDUINO)
+			#define SNMP_TEMPLATE_COUNT 8  // distinct Get requests remembered at once, 0 turns the cache off
+		#else
+			#define SNMP_TEMPLATE_COUNT 2
+		#endif
+	#endif
+	
+	#ifndef SNMP_TEMPLATE_VARBINDS
+		#define SNMP_TEMPLATE_VARBINDS 16  // requests with more varbinds than this are answered the long way every time
+	#endif
+	
+	typedef struct SNMPTemplateStatsStruct
+	{
+	    unsigned long hits = 0;             // Gets answered from a template
+	    unsigned long misses = 0;           // Gets that had to be resolved varbind by varbind
+	    unsigned long stored = 0;
+	    unsigned long evicted = 0;          // thrown out to make room for another
+	    unsigned long admitted = 0;         // seen once, remembered if they come again
+	} SNMPTemplateStats;
+	
+	typedef struct SNMPResponseTemplateStruct
+	{
+	    uint32_t hash;
+	    unsigned long lastUsed;
+	    int version;
+	    uint8_t varBindCount;
+	    unsigned short communityLength;
+	    unsigned short keyLength;
+	    ValueCallback** handlers;   // one per varbind, in order
+	    unsigned char* key;         // the community then the encoded varbind list, as the request had them
+	} SNMPResponseTemplate;
+	
+	// A handful of templates in one malloc'd block each, the least recently used makes way for a new one.
+	// Anything that changes the handler list has to clear() them, they hold handler pointers.
+	class SNMPResponseTemplates {
+	  public:
+	    SNMPResponseTemplates(){};
+	    ~SNMPResponseTemplates()
+	    {
+	        clear();
+	    };
+	
+	    SNMPResponseTemplate* find(SNMPRequest* request);
+	    bool store(SNMPRequest* request, ValueCallback** handlers);
+	    void clear();
+	
+	    SNMPTemplateStats stats;
+	
+	  private:
+	    static uint32_t hash(SNMPRequest* request);
+	    SNMPResponseTemplate* _templates[SNMP_TEMPLATE_COUNT > 0 ? SNMP_TEMPLATE_COUNT : 1] = {0};
+	    uint32_t _seen[SNMP_TEMPLATE_COUNT > 0 ? SNMP_TEMPLATE_COUNT : 1] = {0}; // hashes of requests that missed once
+	    uint8_t _nextSeen = 0;
+	    unsigned long _uses = 0;
+	};
+	
+	uint32_t SNMPResponseTemplates::hash(SNMPRequest* request)
+	{
+	    // FNV-1a over what makes two requests the same
+	    uint32_t value = 2166136261u ^ (uint32_t)request->version;
+	    value *= 16777619u;
+	    for(int i = 0; i < request->communityLength; i++){
+	        value = (value ^ request->communityString[i]) * 16777619u;
+	    }
+	    for(int i = 0; i < request->varBinds.length; i++){
+	        value = (value ^ request->varBinds.value[i]) * 16777619u;
+	    }
+	    return value;
+	}
+	
+	SNMPResponseTemplate* SNMPResponseTemplates::find(SNMPRequest* request)
+	{
+	    if(SNMP_TEMPLATE_COUNT == 0){
+	        return 0;
+	    }
+	    uint32_t requestHash = hash(request);
+	    for(int i = 0; i < SNMP_TEMPLATE_COUNT; i++){
+	        SNMPResponseTemplate* entry = _templates[i];
+	        if(entry && entry->hash == requestHash && entry->version == request->version
+	            && entry->communityLength == request->communityLength
+	            && entry->keyLength == request->communityLength + request->varBinds.length
+	            && memcmp(entry->key, request->communityString, entry->communityLength) == 0
+	            && memcmp(entry->key + entry->communityLength, request->varBinds.value, request->varBinds.length) == 0){
+	            entry->lastUsed = ++_uses;
+	            stats.hits++;
+	            return entry;
+	        }
+	    }
+	    stats.misses++;
+	    return 0;
+	}
+	
+	bool SNMPResponseTemplates::store(SNMPRequest* request, ValueCallback** handlers)
+	{
+	    if(SNMP_TEMPLATE_COUNT == 0 || request->varBindCount == 0 || request->varBindCount > SNMP_TEMPLATE_VARBINDS){
+	        return false;
+	    }
+	    
+	    uint32_t requestHash = hash(request);
+	    bool seen = false;
+	    for(int i = 0; i < SNMP_TEMPLATE_COUNT; i++){
+	        if(_seen[i] == requestHash){
+	            _seen[i] = 0;
+	            seen = true;
+	            break;
+	        }
+	    }
+	    if(!seen){
+	        _seen[_nextSeen] = requestHash;
+	        _nextSeen = (_nextSeen + 1) % SNMP_TEMPLATE_COUNT;
+	        stats.admitted++;
+	        return false;
+	    }
+	
+	    // the OIDs will be copied out of the request, so they have to be encoded just as the handlers' would be
+	    VarBind varbind;
+	    unsigned char encoded[MAX_OID_SUBIDENTIFIERS * 5];
+	    request->resetVarBinds();
+	    for(int i = 0; request->nextVarBind(varbind); i++){
+	        BERWriter writer(encoded, sizeof(encoded));
+	        OIDType(handlers[i]->oidSubids, handlers[i]->oidLength).serialise(writer);
+	        BERWriter counter;
+	        int headerLength = counter.putHeader(OID, varbind.oid.length);
+	        if(writer.overflow || writer.length() != headerLength + varbind.oid.length
+	            || memcmp(writer.data() + headerLength, varbind.oid.value, varbind.oid.length) != 0){
+	            request->resetVarBinds();
+	            return false;
+	        }
+	    }
+	    request->resetVarBinds();
+	
+	    int keyLength = request->communityLength + request->varBinds.length;
+	    SNMPResponseTemplate* entry = (SNMPResponseTemplate*)malloc(sizeof(SNMPResponseTemplate) + sizeof(ValueCallback*) * request->varBindCount + keyLength);
+	    if(!entry){
+	        return false;
+	    }
+	    entry->hash = requestHash;
+	    entry->lastUsed = ++_uses;
+	    entry->version = request->version;
+	    entry->varBindCount = request->varBindCount;
+	    entry->communityLength = request->communityLength;
+	    entry->keyLength = keyLength;
+	    entry->handlers = (ValueCallback**)(entry + 1);
+	    memcpy(entry->handlers, handlers, sizeof(ValueCallback*) * request->varBindCount);
+	    entry->key = (unsigned char*)(entry->handlers + request->varBindCount);
+	    memcpy(entry->key, request->communityString, request->communityLength);
+	    memcpy(entry->key + request->communityLength, request->varBinds.value, request->varBinds.length);
+	
+	    // an empty slot, or the one that's gone longest without a hit
+	    int slot = 0;
+	    for(int i = 0; i < SNMP_TEMPLATE_COUNT; i++){
+	        if(!_templates[i]){
+	            slot = i;
+	            break;
+	        }
+	        if(_templates[i]->lastUsed < _templates[slot]->lastUsed){
+	            slot = i;
+	        }
+	    }
+	    if(_templates[slot]){
+	        free(_templates[slot]);
+	        stats.evicted++;
+	    }
+	    _templates[slot] = entry;
+	    stats.stored++;
+	    return true;
+	}
+	
+	void SNMPResponseTemplates::clear()
+	{
+	    for(int i = 0; i < SNMP_TEMPLATE_COUNT; i++){
+	        free(_templates[i]);
+	        _templates[i] = 0;
+	    }
+	}
+	
+#endif
@@ -7,7 +7,7 @@
 	
 	class SNMPTrap {
 	  public:
-	    SNMPTrap(const char* community, short version): _community(community), _version(version)
+	    SNMPTrap(const char* community, short version): _version(version), _community(community)
 	    {
 	        if(version == 0)
 	        {
@@ -26,6 +26,8 @@
 	    TimestampCallback* uptimeCallback;
 	    short genericTrap = 6;
 	    short specificTrap;
+	    bool inform = false;            // v2c only: sent as an InformRequest, which the manager acknowledges
+	    unsigned long requestID = 0;    // v2c, what an acknowledgement is matched on
 	    
 	    // the setters that need to be configured for each trap
 	    
@@ -38,6 +40,13 @@
 	    {
 	        specificTrap = num;
 	    }
+	    
+	    // queued with SNMPAgent::queueTrap() an inform is sent again until every receiver has acknowledged
+	    // it, see SNMPAgent::setInformTimeout()
+	    void setInform(bool isInform)
+	    {
+	        inform = isInform;
+	    }
 	    void setIP(IPAddress ip)		// sets our IP
 	    {
 	        agentIP = ip;
@@ -79,18 +88,32 @@
 	            return false;
 	        }
 	        Snmp_Serial_println("[DEBUG Trap] Sending packet...");
-	        unsigned char _packetBuffer[SNMP_PACKET_LENGTH*3];
-	        memset(_packetBuffer, 0, SNMP_PACKET_LENGTH*3);
-	        int length = packet->serialise(_packetBuffer);
+	        // measured first and encoded into a block of just that size rather than a whole packet's
+	        // worth of stack, SNMPAgent::sendTrap() uses the agent's own buffer instead
+	        BERWriter counter;
+	        int length = packet->serialise(counter);
+	        unsigned char* buffer = length <= SNMP_TX_BUFFER_LENGTH ? (unsigned char*)malloc(length) : 0;
+	        if(buffer)
+	        {
+	            BERWriter writer(buffer, length);
+	            packet->serialise(writer);
+	        }
 	        delete packet;
 	        packet = 0;
+	        if(!buffer)
+	        {
+	            Snmp_Serial_println("[DEBUG Trap] Packet too big...");
+	            return false;
+	        }
 	        _udp->beginPacket(ip, port);
-	        _udp->write(_packetBuffer, length);
+	        _udp->write(buffer, length);
+	        free(buffer);
 	        return _udp->endPacket();
 	    }
 	    
 	    ComplexType* packet = 0;
 	    bool build();
+	    bool addVarBinds(ComplexType* varBindList); // one for each OID pointer, with its value as it is now
 	    
 	    bool version1 = false;
 	    bool version2 = false;
@@ -107,6 +130,7 @@
 	bool SNMPTrap::build()
 		{
 	    if(packet) delete packet;
+	    SNMPPublishedGroup::newRequest();
 	    packet = new ComplexType(STRUCTURE);
 	    packet->addValueToList(new IntegerType((int)_version));
 	    packet->addValueToList(new OctetType((char*)_community));
@@ -117,33 +141,79 @@
 	    }
 	    else if(version2)
 	    {
-	        trapPDU = new ComplexType(Trapv2PDU);
+	        trapPDU = new ComplexType(inform ? InformRequestPDU : Trapv2PDU);
 	    }
 	    else
 	    {
 	        return false;
 	    }
 	    
-	    trapPDU->addValueToList(new OIDType(trapOID->_value));
+	    if(version2)
+	    {
+	        // RFC 3416: a v2 notification is laid out like any other PDU, sysUpTime.0 and snmpTrapOID.0 lead the varbinds
+	        static const uint32_t sysUpTimeOID[] = {1, 3, 6, 1, 2, 1, 1, 3, 0};
+	        static const uint32_t snmpTrapOID[] = {1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0};
+	        trapPDU->addValueToList(new IntegerType(requestID));
+	        trapPDU->addValueToList(new IntegerType(0));
+	        trapPDU->addValueToList(new IntegerType(0));
+	        ComplexType* varBindList = new ComplexType(STRUCTURE);
+	        ComplexType* varBind = new ComplexType(STRUCTURE);
+	        varBind->addValueToList(new OIDType(sysUpTimeOID, 9));
+	        uptimeCallback->refresh();
+	        varBind->addValueToList(new TimestampType(*(uptimeCallback->value)));
+	        varBindList->addValueToList(varBind);
+	        varBind = new ComplexType(STRUCTURE);
+	        varBind->addValueToList(new OIDType(snmpTrapOID, 11));
+	        varBind->addValueToList(new OIDType(trapOID->_value, trapOID->_valueLength));
+	        varBindList->addValueToList(varBind);
+	        if(!addVarBinds(varBindList))
+	        {
+	            delete varBindList;
+	            delete trapPDU;
+	            return false;
+	        }
+	        trapPDU->addValueToList(varBindList);
+	        packet->addValueToList(trapPDU);
+	        return true;
+	    }
+	    
+	    trapPDU->addValueToList(new OIDType(trapOID->_value, trapOID->_valueLength));
 	    trapPDU->addValueToList(new NetworkAddress(agentIP));
 	    trapPDU->addValueToList(new IntegerType(genericTrap));
 	    trapPDU->addValueToList(new IntegerType(specificTrap));
+	    uptimeCallback->refresh();
 	    trapPDU->addValueToList(new TimestampType(*(uptimeCallback->value)));
 	    ComplexType* varBindList = new ComplexType(STRUCTURE);
 	    
+	    if(!addVarBinds(varBindList))
+	    {
+	        delete varBindList;
+	        delete trapPDU;
+	        return false;
+	    }
+	    
+	    trapPDU->addValueToList(varBindList);
+	    packet->addValueToList(trapPDU);
+	    return true;
+	}
+	
+	bool SNMPTrap::addVarBinds(ComplexType* varBindList)
+	{
 	    callbacksCursor = callbacks;
 	    if(callbacksCursor->value)
 	    {
 	        while(true)
 	       	{
 	            ComplexType* varBind = new ComplexType(STRUCTURE);
-	            varBind->addValueToList(new OIDType(callbacksCursor->value->OID));
+	            varBind->addValueToList(new OIDType(callbacksCursor->value->oidSubids, callbacksCursor->value->oidLength));
 	            BER_CONTAINER* value;
+	            callbacksCursor->value->refresh();
 	            switch(callbacksCursor->value->type)
 	            {
 	                case INTEGER:
 	                	{
-	                		value = new IntegerType(*((IntegerCallback*)callbacksCursor->value)->value);
+	                		IntegerCallback* integer = (IntegerCallback*)callbacksCursor->value;
+	                		value = integer->isFloat ? new IntegerType(*(float*)integer->value * 10) : new IntegerType(*integer->value);
 	                	}
 	                	break;
 	                case TIMESTAMP:
@@ -153,9 +223,40 @@
 	                	break;
 	                case STRING:
 	                	{
-	                		value = new OctetType(*((StringCallback*)callbacksCursor->value)->value);
+	                		StringCallback* string = (StringCallback*)callbacksCursor->value;
+	                		value = string->length < 0 ? new OctetType(*string->value) : new OctetType((unsigned char*)*string->value, string->length);
+	                	}
+	                	break;
+	                case OID:
+	                	{
+	                		OIDCallback* oid = (OIDCallback*)callbacksCursor->value;
+	                		value = oid->subids ? new OIDType(oid->subids, oid->subidsLength) : new OIDType(oid->value);
+	                	}
+	                	break;
+	                case COUNTER32:
+	                	{
+	                		value = new Counter32(*((Counter32Callback*)callbacksCursor->value)->value);
 	                	}
 	                	break;
+	                case GUAGE32:
+	                	{
+	                		value = new Guage(*((Guage32Callback*)callbacksCursor->value)->value);
+	                	}
+	                	break;
+	                case COUNTER64:
+	                	{
+	                		if(version1)
+	                		{
+	                			// SNMPv1 has no Counter64, RFC 2576 3.2 has the notification left unsent instead
+	                			delete varBind;
+	                			return false;
+	                		}
+	                		value = new Counter64(*((Counter64Callback*)callbacksCursor->value)->value);
+	                	}
+	                	break;
+	                default:
+	                	value = new NullType();
+	                	break;
 	            }
 	            varBind->addValueToList(value);
 	            varBindList->addValueToList(varBind);
@@ -170,9 +271,6 @@
 	            }
 	        }
 	    }
-	    
-	    trapPDU->addValueToList(varBindList);
-	    packet->addValueToList(trapPDU);
 	    return true;
 	}
 	
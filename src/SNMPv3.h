@@ -0,0 +1,781 @@
+// SNMPv3 with the User-based Security Model (RFC 3414): HMAC-SHA-96 authentication and AES-128
+// privacy (CFB, RFC 3826). Turning a password into a key means hashing a megabyte of it, which takes
+// a while on a microcontroller, so it's done once when the user is added and the key kept. Only the
+// short step that ties the key to this agent's engineID is done again if the engineID changes, and a
+// user added with keys saved from an earlier start skips the megabyte altogether.
+//
+// A request is checked and decrypted where it sits in the receive buffer, and the response is
+// encrypted and signed where it's written in the send buffer.
+
+#ifndef SNMPv3_h
+	#define SNMPv3_h
+	
+	#ifndef SNMP_V3
+		#if defined(ESP32) || defined(ESP8266) || !defined(ARDUINO)
+			#define SNMP_V3 1  // without it v3 requests are dropped, as they always were
+		#else
+			#define SNMP_V3 0  // the AES tables alone would take an eighth of an AVR's RAM
+		#endif
+	#endif
+	
+	#if SNMP_V3
+	
+	#ifndef SNMP_V3_USERS
+		#define SNMP_V3_USERS 2  // each one keeps about 120 bytes of keys
+	#endif
+	
+	#define SNMP_V3_ENGINE_ID_LENGTH 32  // longest an engineID can be, RFC 3411
+	#define SNMP_V3_TIME_WINDOW 150      // seconds a request's engineTime may be out by, RFC 3414
+	
+	// msgFlags
+	#define SNMP_V3_AUTH 0x01
+	#define SNMP_V3_PRIV 0x02
+	#define SNMP_V3_REPORTABLE 0x04
+	
+	class SNMPSha1 {
+	  public:
+	    SNMPSha1()
+	    {
+	        reset();
+	    };
+	
+	    void reset();
+	    void update(const unsigned char* data, size_t length);
+	    void finish(unsigned char digest[20]);
+	    // carries on from a state saved after a number of whole blocks
+	    void resume(const uint32_t saved[5], uint32_t blocks);
+	
+	    uint32_t state[5];
+	
+	  private:
+	    void compress(const unsigned char* block);
+	    uint64_t _length; // bytes hashed so far
+	    unsigned char _block[64];
+	};
+	
+	void SNMPSha1::reset()
+	{
+	    state[0] = 0x67452301;
+	    state[1] = 0xEFCDAB89;
+	    state[2] = 0x98BADCFE;
+	    state[3] = 0x10325476;
+	    state[4] = 0xC3D2E1F0;
+	    _length = 0;
+	}
+	
+	void SNMPSha1::resume(const uint32_t saved[5], uint32_t blocks)
+	{
+	    memcpy(state, saved, sizeof(state));
+	    _length = (uint64_t)blocks * 64;
+	}
+	
+	void SNMPSha1::update(const unsigned char* data, size_t length)
+	{
+	    size_t used = _length % 64;
+	    _length += length;
+	    if(used){
+	        size_t take = 64 - used < length ? 64 - used : length;
+	        memcpy(_block + used, data, take);
+	        data += take;
+	        length -= take;
+	        if(used + take < 64){
+	            return;
+	        }
+	        compress(_block);
+	    }
+	    // whole blocks are hashed where they are, only the tail is copied
+	    while(length >= 64){
+	        compress(data);
+	        data += 64;
+	        length -= 64;
+	    }
+	    memcpy(_block, data, length);
+	}
+	
+	void SNMPSha1::finish(unsigned char digest[20])
+	{
+	    uint64_t bits = _length * 8;
+	    unsigned char padding[72] = {0x80};
+	    size_t paddingLength = (_length % 64 < 56 ? 56 : 120) - _length % 64;
+	    for(int i = 0; i < 8; i++){
+	        padding[paddingLength + i] = bits >> (56 - 8 * i);
+	    }
+	    update(padding, paddingLength + 8);
+	    for(int i = 0; i < 20; i++){
+	        digest[i] = state[i / 4] >> (24 - 8 * (i % 4));
+	    }
+	}
+	
+	void SNMPSha1::compress(const unsigned char* block)
+	{
+	    uint32_t w[16];
+	    for(int i = 0; i < 16; i++){
+	        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+	    }
+	    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	    for(int i = 0; i < 80; i++){
+	        if(i >= 16){
+	            // the message schedule in a ring of 16 words rather than 80
+	            uint32_t x = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+	            w[i & 15] = x << 1 | x >> 31;
+	        }
+	        uint32_t f, k;
+	        if(i < 20){
+	            f = (b & c) | (~b & d);
+	            k = 0x5A827999;
+	        } else if(i < 40){
+	            f = b ^ c ^ d;
+	            k = 0x6ED9EBA1;
+	        } else if(i < 60){
+	            f = (b & c) | (b & d) | (c & d);
+	            k = 0x8F1BBCDC;
+	        } else {
+	            f = b ^ c ^ d;
+	            k = 0xCA62C1D6;
+	        }
+	        uint32_t next = (a << 5 | a >> 27) + f + e + k + w[i & 15];
+	        e = d;
+	        d = c;
+	        c = b << 30 | b >> 2;
+	        b = a;
+	        a = next;
+	    }
+	    state[0] += a;
+	    state[1] += b;
+	    state[2] += c;
+	    state[3] += d;
+	    state[4] += e;
+	}
+	
+	// AES-128, encryption only: CFB mode runs the cipher forwards to decrypt as well
+	class SNMPAes128 {
+	  public:
+	    SNMPAes128(const unsigned char key[16]);
+	
+	    void encryptBlock(unsigned char block[16]);
+	    // CFB-128 over data in place, any length
+	    void encryptCFB(unsigned char* data, int length, const unsigned char iv[16])
+	    {
+	        cfb(data, length, iv, false);
+	    }
+	    void decryptCFB(unsigned char* data, int length, const unsigned char iv[16])
+	    {
+	        cfb(data, length, iv, true);
+	    }
+	
+	  private:
+	    unsigned char _roundKeys[176];
+	    static const unsigned char sbox[256];
+	    static unsigned char xtime(unsigned char x)
+	    {
+	        return (x << 1) ^ ((x & 0x80) ? 0x1B : 0);
+	    }
+	    void cfb(unsigned char* data, int length, const unsigned char iv[16], bool decrypt);
+	};
+	
+	const unsigned char SNMPAes128::sbox[256] = {
+	    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+	};
+	
+	SNMPAes128::SNMPAes128(const unsigned char key[16])
+	{
+	    memcpy(_roundKeys, key, 16);
+	    unsigned char rcon = 1;
+	    for(int i = 16; i < 176; i += 4){
+	        unsigned char word[4] = {_roundKeys[i - 4], _roundKeys[i - 3], _roundKeys[i - 2], _roundKeys[i - 1]};
+	        if(i % 16 == 0){
+	            unsigned char first = word[0];
+	            word[0] = sbox[word[1]] ^ rcon;
+	            word[1] = sbox[word[2]];
+	            word[2] = sbox[word[3]];
+	            word[3] = sbox[first];
+	            rcon = xtime(rcon);
+	        }
+	        for(int k = 0; k < 4; k++){
+	            _roundKeys[i + k] = _roundKeys[i - 16 + k] ^ word[k];
+	        }
+	    }
+	}
+	
+	void SNMPAes128::encryptBlock(unsigned char block[16])
+	{
+	    for(int i = 0; i < 16; i++){
+	        block[i] ^= _roundKeys[i];
+	    }
+	    for(int round = 1; round <= 10; round++){
+	        // SubBytes and ShiftRows in one go, the state is column by column
+	        unsigned char shifted[16];
+	        for(int i = 0; i < 16; i++){
+	            shifted[i] = sbox[block[(i + 4 * (i % 4)) % 16]];
+	        }
+	        for(int column = 0; column < 16; column += 4){
+	            unsigned char* s = shifted + column;
+	            if(round < 10){
+	                unsigned char all = s[0] ^ s[1] ^ s[2] ^ s[3];
+	                unsigned char first = s[0];
+	                s[0] ^= all ^ xtime(s[0] ^ s[1]);
+	                s[1] ^= all ^ xtime(s[1] ^ s[2]);
+	                s[2] ^= all ^ xtime(s[2] ^ s[3]);
+	                s[3] ^= all ^ xtime(s[3] ^ first);
+	            }
+	            for(int k = 0; k < 4; k++){
+	                block[column + k] = s[k] ^ _roundKeys[16 * round + column + k];
+	            }
+	        }
+	    }
+	}
+	
+	void SNMPAes128::cfb(unsigned char* data, int length, const unsigned char iv[16], bool decrypt)
+	{
+	    unsigned char feedback[16];
+	    memcpy(feedback, iv, 16);
+	    for(int offset = 0; offset < length; offset += 16){
+	        unsigned char stream[16];
+	        memcpy(stream, feedback, 16);
+	        encryptBlock(stream);
+	        for(int i = 0; i < 16 && offset + i < length; i++){
+	            unsigned char in = data[offset + i];
+	            data[offset + i] = in ^ stream[i];
+	            feedback[i] = decrypt ? in : data[offset + i];
+	        }
+	    }
+	}
+	
+	typedef struct SNMPv3UserStruct
+	{
+	    const char* name = 0;
+	    bool readWrite = false;
+	    bool auth = false;                  // authNoPriv, or authPriv with priv as well
+	    bool priv = false;
+	    unsigned char authKey[20];          // from the password, RFC 3414 Ku. Save it and use addUserWithKeys() next time
+	    unsigned char privKey[20];
+	    unsigned char localAuthKey[20];     // tied to this engineID, Kul
+	    unsigned char localPrivKey[20];
+	    uint32_t hmacInner[5];              // SHA-1 state after each of the HMAC's key blocks, saves hashing two blocks per message
+	    uint32_t hmacOuter[5];
+	} SNMPv3User;
+	
+	typedef struct SNMPv3StatsStruct
+	{
+	    // the usmStats counters of RFC 3414, a Report carries the one that went up
+	    uint32_t unsupportedSecLevels = 0;  // asked for a security level the user doesn't have
+	    uint32_t notInTimeWindows = 0;      // the engineBoots or engineTime were out, mostly a manager that hasn't synchronised yet
+	    uint32_t unknownUserNames = 0;
+	    uint32_t unknownEngineIDs = 0;      // mostly managers discovering the engineID
+	    uint32_t wrongDigests = 0;          // wrong authentication password, or the message was changed on the way
+	    uint32_t decryptionErrors = 0;
+	    uint32_t messages = 0;              // v3 requests that got through all of it
+	} SNMPv3Stats;
+	
+	enum SNMPv3Status
+	{
+	    SNMP_V3_OK,
+	    SNMP_V3_REPORT,     // answer with a Report instead, see SNMPv3Message::report
+	    SNMP_V3_DROP
+	};
+	
+	class SNMPv3Engine;
+	
+	// One message's security: what came in with the request, and what the reply is to carry
+	class SNMPv3Message {
+	  public:
+	    long msgID = 0;
+	    long maxSize = SNMP_TX_BUFFER_LENGTH; // msgMaxSize, the longest reply the manager can take
+	    uint8_t flags = 0;                  // the request's
+	    BERView userName;                   // in the request
+	    SNMPv3User* user = 0;               // set once the request has been authenticated as this user
+	    bool authenticate = false;          // how the reply goes out
+	    bool encrypt = false;
+	    uint8_t report = 0;                 // the usmStats counter a Report carries, 0 if none is due
+	    uint32_t reportCount = 0;
+	    unsigned long requestID = 0;        // for a Report, if the request's PDU could be read
+	    uint32_t boots = 0;                 // the engine's, as of the request
+	    uint32_t time = 0;
+	    BERView scopedPDU;                  // inside the request, decrypted in place if it was encrypted
+	    SNMPv3Engine* engine = 0;
+	
+	    // wraps the PDU already in writer in a whole message, encrypted and signed as need be
+	    int serialise(BERWriter& writer, int pduLength);
+	};
+	
+	class SNMPv3Engine {
+	  public:
+	    SNMPv3Engine(){};
+	
+	    bool addUser(const char* name, const char* authPassword, const char* privPassword, bool readWrite);
+	    bool addUserWithKeys(const char* name, const unsigned char* authKey, const unsigned char* privKey, bool readWrite);
+	    SNMPv3User* findUser(const char* name);
+	    SNMPv3User* findUser(const unsigned char* name, int length);
+	
+	    // RFC 3411 format 5 with bytes that differ between boards until one is set
+	    void setEngineID(const unsigned char* id, int length);
+	    const unsigned char* engineID();
+	    int engineIDLength();
+	
+	    // keep it across restarts and add one each time, RFC 3414 expects it to go up every start
+	    uint32_t boots = 1;
+	    uint32_t time(); // seconds since the engine started, or since boots last went up
+	
+	    // ties every user's keys to the engineID, the first message after a change does it if this doesn't
+	    void localizeKeys();
+	
+	    static bool isV3(const unsigned char* buf, int length);
+	    SNMPv3Status receive(unsigned char* buf, int length, SNMPv3Message* message);
+	    void nextSalt(unsigned char salt[8]);
+	
+	    SNMPv3Stats stats;
+	
+	    static bool passwordToKey(const char* password, unsigned char key[20]);
+	    static void localizeKey(const unsigned char key[20], const unsigned char* engineID, int length, unsigned char localized[20]);
+	    static void hmac(SNMPv3User* user, const unsigned char* data, int length, unsigned char digest[12]);
+	    static void privacyIV(uint32_t boots, uint32_t time, const unsigned char salt[8], unsigned char iv[16]);
+	
+	  private:
+	    SNMPv3User _users[SNMP_V3_USERS];
+	    unsigned char _engineID[SNMP_V3_ENGINE_ID_LENGTH];
+	    uint8_t _engineIDLength = 0;
+	    bool _keysLocalized = false;
+	    uint32_t _seconds = 0;
+	    unsigned long _lastTick = 0;
+	    bool _clockStarted = false;
+	    uint64_t _salt = 0;
+	    SNMPv3User* freeUser(const char* name);
+	    SNMPv3Status reportTo(SNMPv3Message* message, uint8_t counter, uint32_t* count);
+	    static bool readRequestID(BERView scopedPDU, unsigned long* requestID);
+	};
+	
+	bool SNMPv3Engine::passwordToKey(const char* password, unsigned char key[20])
+	{
+	    // RFC 3414 A.2.2: the password repeated over a megabyte, hashed
+	    int length = strlen(password);
+	    if(length < 8){
+	        return false; // RFC 3414 won't have anything shorter
+	    }
+	    SNMPSha1 sha;
+	    unsigned char block[64];
+	    int index = 0;
+	    for(long count = 0; count < 1048576; count += 64){
+	        for(int i = 0; i < 64; i++){
+	            block[i] = password[index++ % length];
+	        }
+	        index %= length;
+	        sha.update(block, 64);
+	        if(count % 65536 == 0){
+	            delay(0); // a few hundred ms on an ESP8266, keep the watchdog fed
+	        }
+	    }
+	    sha.finish(key);
+	    return true;
+	}
+	
+	void SNMPv3Engine::localizeKey(const unsigned char key[20], const unsigned char* engineID, int length, unsigned char localized[20])
+	{
+	    SNMPSha1 sha;
+	    sha.update(key, 20);
+	    sha.update(engineID, length);
+	    sha.update(key, 20);
+	    sha.finish(localized);
+	}
+	
+	void SNMPv3Engine::hmac(SNMPv3User* user, const unsigned char* data, int length, unsigned char digest[12])
+	{
+	    // HMAC-SHA-96, RFC 3414 7: the key blocks were hashed when the key was localized
+	    unsigned char inner[20];
+	    SNMPSha1 sha;
+	    sha.resume(user->hmacInner, 1);
+	    sha.update(data, length);
+	    sha.finish(inner);
+	    sha.resume(user->hmacOuter, 1);
+	    sha.update(inner, 20);
+	    sha.finish(inner);
+	    memcpy(digest, inner, 12);
+	}
+	
+	void SNMPv3Engine::privacyIV(uint32_t boots, uint32_t time, const unsigned char salt[8], unsigned char iv[16])
+	{
+	    // RFC 3826 3.1.2.1: engineBoots, engineTime, then the salt sent as msgPrivacyParameters
+	    for(int i = 0; i < 4; i++){
+	        iv[i] = boots >> (24 - 8 * i);
+	        iv[4 + i] = time >> (24 - 8 * i);
+	    }
+	    memcpy(iv + 8, salt, 8);
+	}
+	
+	SNMPv3User* SNMPv3Engine::freeUser(const char* name)
+	{
+	    // a user added again under the same name replaces the old one
+	    SNMPv3User* user = findUser(name);
+	    for(int i = 0; !user && i < SNMP_V3_USERS; i++){
+	        if(!_users[i].name){
+	            user = &_users[i];
+	        }
+	    }
+	    return user;
+	}
+	
+	bool SNMPv3Engine::addUser(const char* name, const char* authPassword, const char* privPassword, bool readWrite)
+	{
+	    unsigned char authKey[20], privKey[20];
+	    if(authPassword && !passwordToKey(authPassword, authKey)){
+	        return false;
+	    }
+	    if(privPassword && (!authPassword || !passwordToKey(privPassword, privKey))){
+	        return false;
+	    }
+	    return addUserWithKeys(name, authPassword ? authKey : 0, privPassword ? privKey : 0, readWrite);
+	}
+	
+	bool SNMPv3Engine::addUserWithKeys(const char* name, const unsigned char* authKey, const unsigned char* privKey, bool readWrite)
+	{
+	    SNMPv3User* user = freeUser(name);
+	    if(!user || (privKey && !authKey)){
+	        return false;
+	    }
+	    *user = SNMPv3User();
+	    user->name = name;
+	    user->readWrite = readWrite;
+	    user->auth = authKey != 0;
+	    user->priv = privKey != 0;
+	    if(authKey){
+	        memcpy(user->authKey, authKey, 20);
+	    }
+	    if(privKey){
+	        memcpy(user->privKey, privKey, 20);
+	    }
+	    _keysLocalized = false;
+	    return true;
+	}
+	
+	SNMPv3User* SNMPv3Engine::findUser(const char* name)
+	{
+	    return findUser((const unsigned char*)name, strlen(name));
+	}
+	
+	SNMPv3User* SNMPv3Engine::findUser(const unsigned char* name, int length)
+	{
+	    for(int i = 0; i < SNMP_V3_USERS; i++){
+	        if(_users[i].name && (int)strlen(_users[i].name) == length && memcmp(_users[i].name, name, length) == 0){
+	            return &_users[i];
+	        }
+	    }
+	    return 0;
+	}
+	
+	void SNMPv3Engine::setEngineID(const unsigned char* id, int length)
+	{
+	    _engineIDLength = length < SNMP_V3_ENGINE_ID_LENGTH ? length : SNMP_V3_ENGINE_ID_LENGTH;
+	    memcpy(_engineID, id, _engineIDLength);
+	    _keysLocalized = false;
+	}
+	
+	const unsigned char* SNMPv3Engine::engineID()
+	{
+	    if(!_engineIDLength){
+	        // enterprise 0 with the high bit set, format 5 (octets), then eight bytes of this board
+	        unsigned char id[13] = {0x80, 0x00, 0x00, 0x00, 0x05};
+	        #if defined(ESP32)
+	        uint64_t board = ESP.getEfuseMac();
+	        #elif defined(ESP8266)
+	        uint64_t board = ((uint64_t)ESP.getChipId() << 32) | ESP.getFlashChipId();
+	        #else
+	        uint64_t board = ((uint64_t)micros() << 32) ^ (uint64_t)(uintptr_t)this;
+	        #endif
+	        for(int i = 0; i < 8; i++){
+	            id[5 + i] = board >> (56 - 8 * i);
+	        }
+	        setEngineID(id, sizeof(id));
+	    }
+	    return _engineID;
+	}
+	
+	int SNMPv3Engine::engineIDLength()
+	{
+	    engineID();
+	    return _engineIDLength;
+	}
+	
+	uint32_t SNMPv3Engine::time()
+	{
+	    unsigned long now = millis();
+	    if(!_clockStarted){
+	        _lastTick = now;
+	        _clockStarted = true;
+	    }
+	    unsigned long elapsed = (now - _lastTick) / 1000;
+	    _seconds += elapsed;
+	    _lastTick += elapsed * 1000;
+	    if(_seconds > 2147483647UL){
+	        // RFC 3414 2.2.2: engineTime never goes past 2^31 - 1, engineBoots goes up instead
+	        boots++;
+	        _seconds = 0;
+	    }
+	    return _seconds;
+	}
+	
+	void SNMPv3Engine::nextSalt(unsigned char salt[8])
+	{
+	    // RFC 3826 3.1.2.1: a 64 bit counter, started somewhere unpredictable
+	    if(!_salt){
+	        _salt = ((uint64_t)micros() << 32) ^ ((uint64_t)boots << 16) ^ millis();
+	    }
+	    _salt++;
+	    for(int i = 0; i < 8; i++){
+	        salt[i] = _salt >> (56 - 8 * i);
+	    }
+	}
+	
+	void SNMPv3Engine::localizeKeys()
+	{
+	    engineID(); // made up first if it hasn't been set
+	    for(int i = 0; i < SNMP_V3_USERS; i++){
+	        SNMPv3User* user = &_users[i];
+	        if(!user->name || !user->auth){
+	            continue;
+	        }
+	        localizeKey(user->authKey, _engineID, _engineIDLength, user->localAuthKey);
+	        if(user->priv){
+	            localizeKey(user->privKey, _engineID, _engineIDLength, user->localPrivKey);
+	        }
+	
+	        // the HMAC's key blocks only depend on the key, so they're hashed once here
+	        unsigned char block[64] = {0};
+	        SNMPSha1 sha;
+	        for(int k = 0; k < 64; k++){
+	            block[k] = (k < 20 ? user->localAuthKey[k] : 0) ^ 0x36;
+	        }
+	        sha.update(block, 64);
+	        memcpy(user->hmacInner, sha.state, sizeof(sha.state));
+	        sha.reset();
+	        for(int k = 0; k < 64; k++){
+	            block[k] = (k < 20 ? user->localAuthKey[k] : 0) ^ 0x5C;
+	        }
+	        sha.update(block, 64);
+	        memcpy(user->hmacOuter, sha.state, sizeof(sha.state));
+	    }
+	    _keysLocalized = true;
+	}
+	
+	bool SNMPv3Engine::isV3(const unsigned char* buf, int length)
+	{
+	    // a message whose version is 3
+	    BERView view;
+	    BERReader packet((unsigned char*)buf, length);
+	    long version;
+	    return packet.expect(STRUCTURE, view) && BERReader(view).expect(INTEGER, view) && BERReader::readInteger(view, version) && version == 3;
+	}
+	
+	bool SNMPv3Engine::readRequestID(BERView scopedPDU, unsigned long* requestID)
+	{
+	    BERView view;
+	    long number;
+	    BERReader reader(scopedPDU);
+	    if(!reader.expect(STRING, view) || !reader.expect(STRING, view) || !reader.next(view)){
+	        return false;
+	    }
+	    BERReader pdu(view);
+	    if(!pdu.expect(INTEGER, view) || !BERReader::readInteger(view, number)){
+	        return false;
+	    }
+	    *requestID = number;
+	    return true;
+	}
+	
+	SNMPv3Status SNMPv3Engine::reportTo(SNMPv3Message* message, uint8_t counter, uint32_t* count)
+	{
+	    (*count)++;
+	    message->report = counter;
+	    message->reportCount = *count;
+	    // only notInTimeWindow goes back authenticated, it's how an authenticated manager learns our clock
+	    message->authenticate = counter == 2;
+	    message->encrypt = false;
+	    if(!message->authenticate){
+	        message->user = 0;
+	    }
+	    return (message->flags & SNMP_V3_REPORTABLE) ? SNMP_V3_REPORT : SNMP_V3_DROP;
+	}
+	
+	SNMPv3Status SNMPv3Engine::receive(unsigned char* buf, int length, SNMPv3Message* message)
+	{
+	    message->engine = this;
+	    message->time = time();
+	    message->boots = boots;
+	    if(!_keysLocalized){
+	        localizeKeys();
+	    }
+	
+	    // RFC 3412 message, with RFC 3414 security parameters inside an OCTET STRING
+	    BERView view, global, security, engine, authentication, privacy, flags;
+	    long number, msgBoots, msgTime;
+	    BERReader packet(buf, length);
+	    if(!packet.expect(STRUCTURE, view)){
+	        return SNMP_V3_DROP;
+	    }
+	    int messageLength = view.value + view.length - buf; // what the digest covers
+	    BERReader fields(view);
+	    if(!fields.expect(INTEGER, view) || !fields.expect(STRUCTURE, global) || !fields.expect(STRING, security) || !fields.next(message->scopedPDU)){
+	        return SNMP_V3_DROP;
+	    }
+	    BERReader globalData(global);
+	    if(!globalData.expect(INTEGER, view) || !BERReader::readInteger(view, message->msgID)
+	        || !globalData.expect(INTEGER, view) || !BERReader::readInteger(view, message->maxSize)
+	        || message->maxSize < 484 // RFC 3412, every engine takes at least that
+	        || !globalData.expect(STRING, flags) || flags.length != 1
+	        || !globalData.expect(INTEGER, view) || !BERReader::readInteger(view, number) || number != 3){ // the USM, nothing else
+	        return SNMP_V3_DROP;
+	    }
+	    message->flags = flags.value[0];
+	    BERReader parameters(security);
+	    if(!parameters.expect(STRUCTURE, view)){
+	        return SNMP_V3_DROP;
+	    }
+	    BERReader usm(view);
+	    if(!usm.expect(STRING, engine)
+	        || !usm.expect(INTEGER, view) || !BERReader::readInteger(view, msgBoots)
+	        || !usm.expect(INTEGER, view) || !BERReader::readInteger(view, msgTime)
+	        || !usm.expect(STRING, message->userName)
+	        || !usm.expect(STRING, authentication)
+	        || !usm.expect(STRING, privacy)){
+	        return SNMP_V3_DROP;
+	    }
+	    bool auth = message->flags & SNMP_V3_AUTH;
+	    bool priv = message->flags & SNMP_V3_PRIV;
+	    if(priv && !auth){
+	        return SNMP_V3_DROP; // RFC 3412 7.2 step 5, not a valid combination
+	    }
+	    if(message->scopedPDU.type == STRUCTURE){
+	        readRequestID(message->scopedPDU, &message->requestID);
+	    }
+	
+	    // RFC 3414 3.2, in its order: engineID (which is how a manager discovers it), user, security level, digest, time
+	    if(engine.length != engineIDLength() || memcmp(engine.value, _engineID, _engineIDLength) != 0){
+	        return reportTo(message, 4, &stats.unknownEngineIDs);
+	    }
+	    message->user = findUser(message->userName.value, message->userName.length);
+	    if(!message->user){
+	        return reportTo(message, 3, &stats.unknownUserNames);
+	    }
+	    if(auth != message->user->auth || priv != message->user->priv){
+	        return reportTo(message, 1, &stats.unsupportedSecLevels);
+	    }
+	    if(auth){
+	        // the digest is worked out with its own field zeroed, right there in the packet
+	        unsigned char received[12], expected[12];
+	        if(authentication.length != 12){
+	            return reportTo(message, 5, &stats.wrongDigests);
+	        }
+	        memcpy(received, authentication.value, 12);
+	        memset(authentication.value, 0, 12);
+	        hmac(message->user, buf, messageLength, expected);
+	        unsigned char difference = 0;
+	        for(int i = 0; i < 12; i++){
+	            difference |= received[i] ^ expected[i];
+	        }
+	        if(difference){
+	            return reportTo(message, 5, &stats.wrongDigests);
+	        }
+	        if(boots == 2147483647UL || msgBoots != (long)boots || labs(msgTime - (long)message->time) > SNMP_V3_TIME_WINDOW){
+	            return reportTo(message, 2, &stats.notInTimeWindows);
+	        }
+	    }
+	    if(priv){
+	        if(privacy.length != 8 || message->scopedPDU.type != STRING){
+	            return reportTo(message, 6, &stats.decryptionErrors);
+	        }
+	        unsigned char iv[16];
+	        privacyIV(msgBoots, msgTime, privacy.value, iv);
+	        SNMPAes128(message->user->localPrivKey).decryptCFB(message->scopedPDU.value, message->scopedPDU.length, iv);
+	        BERReader plain(message->scopedPDU);
+	        if(!plain.expect(STRUCTURE, view)){
+	            return reportTo(message, 6, &stats.decryptionErrors);
+	        }
+	        message->scopedPDU = view;
+	    } else if(message->scopedPDU.type != STRUCTURE){
+	        return SNMP_V3_DROP;
+	    }
+	    message->authenticate = auth;
+	    message->encrypt = priv;
+	    stats.messages++;
+	    return SNMP_V3_OK;
+	}
+	
+	int SNMPv3Message::serialise(BERWriter& writer, int pduLength)
+	{
+	    // written back to front like the PDU: scopedPDU first, in the engine's default context
+	    int engineIDLength = engine->engineIDLength();
+	    int length = pduLength + writer.putHeader(STRING, 0);
+	    writer.putBytes(engine->engineID(), engineIDLength);
+	    length += engineIDLength + writer.putHeader(STRING, engineIDLength);
+	    length += writer.putHeader(STRUCTURE, length);
+	
+	    unsigned char salt[8] = {0};
+	    if(encrypt){
+	        if(!writer._measuring && !writer.overflow){
+	            unsigned char iv[16];
+	            engine->nextSalt(salt);
+	            SNMPv3Engine::privacyIV(boots, time, salt, iv);
+	            SNMPAes128(user->localPrivKey).encryptCFB(writer.data(), length, iv);
+	        }
+	        length += writer.putHeader(STRING, length);
+	    }
+	
+	    // msgSecurityParameters, BER inside an OCTET STRING. The digest goes in last, once it covers everything
+	    int security = 0;
+	    if(encrypt){
+	        writer.putBytes(salt, 8);
+	        security += 8;
+	    }
+	    security += writer.putHeader(STRING, encrypt ? 8 : 0);
+	    unsigned char digest[12] = {0};
+	    if(authenticate){
+	        writer.putBytes(digest, 12);
+	        security += 12;
+	    }
+	    unsigned char* digestField = writer.data();
+	    security += writer.putHeader(STRING, authenticate ? 12 : 0);
+	    writer.putBytes(userName.value, userName.length);
+	    security += userName.length + writer.putHeader(STRING, userName.length);
+	    security += IntegerType(time).serialise(writer);
+	    security += IntegerType(boots).serialise(writer);
+	    writer.putBytes(engine->engineID(), engineIDLength);
+	    security += engineIDLength + writer.putHeader(STRING, engineIDLength);
+	    security += writer.putHeader(STRUCTURE, security);
+	    length += security + writer.putHeader(STRING, security);
+	
+	    // msgGlobalData: msgID, msgMaxSize, msgFlags, msgSecurityModel
+	    unsigned char replyFlags = (authenticate ? SNMP_V3_AUTH : 0) | (encrypt ? SNMP_V3_PRIV : 0);
+	    int global = IntegerType(3).serialise(writer);
+	    writer.putBytes(&replyFlags, 1);
+	    global += 1 + writer.putHeader(STRING, 1);
+	    global += IntegerType(SNMP_RX_BUFFER_LENGTH).serialise(writer);
+	    global += IntegerType(msgID).serialise(writer);
+	    length += global + writer.putHeader(STRUCTURE, global);
+	    length += IntegerType(3).serialise(writer);
+	    length += writer.putHeader(STRUCTURE, length);
+	
+	    if(writer.overflow){
+	        return 0;
+	    }
+	    if(authenticate && !writer._measuring){
+	        SNMPv3Engine::hmac(user, writer.data(), length, digestField);
+	    }
+	    return length;
+	}
+	
+	#endif
+	
+#endif
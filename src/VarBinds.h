@@ -1,31 +1,16 @@
 #ifndef VarBinds_h
 	#define VarBinds_h
 	
+	// A varbind as it sits in the received packet, both halves are views into the packet buffer
 	typedef struct VarBindStruct
 	{
-		~VarBindStruct()
-		{
-			//if(value) delete value;
-			//if(oid) delete oid;
-		};
+		BERView oid;
+		BERView value;
 		
-		OIDType *oid = 0;
-		ASN_TYPE type;
-		BER_CONTAINER *value = 0;
-	} VarBind;
-	
-	typedef struct VarBindListStruct
-	{
-		~VarBindListStruct()
+		ASN_TYPE type()
 		{
-			delete next;
-			next = 0;
-			delete value;
-			value = 0;
-		};
-	    
-		struct VarBindStruct *value = 0;
-		struct VarBindListStruct *next = 0;
-	} VarBindList;
+			return value.type;
+		}
+	} VarBind;
 	
 #endif